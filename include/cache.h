@@ -0,0 +1,45 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define CACHE_DEFAULT_MAX_BYTES (64UL * 1024 * 1024)
+#define CACHE_DEFAULT_MAX_ENTRIES 10000
+#define CACHE_PROBE_LIMIT 8
+#define CACHE_ETAG_SIZE 64
+
+/*
+ * A cached response. Objects are reference counted so an entry can be
+ * evicted while a connection is still sending it; the memory is released
+ * when the last reference is dropped with cache_release(). Lookups in the
+ * shared cache return a handle whose data points into the shared arena and
+ * pins the entry's bytes there until it is released, so writers evict
+ * around it. data holds a complete response; the first header_length bytes
+ * are the status line and headers, so HEAD requests can send just that
+ * prefix.
+ */
+typedef struct cache_object {
+    int refs;
+    size_t length;
+    size_t header_length;
+    const char *data;
+    uint32_t *pin;  // shared arena pin count held by this handle, NULL for private objects
+    char etag[CACHE_ETAG_SIZE];
+    char storage[];
+} cache_object_t;
+
+int cache_init(size_t max_bytes, size_t max_entries, time_t timeout, int shared, int workers);
+void cache_set_worker(int worker_id);
+void cache_reclaim_worker(int worker_id);
+cache_object_t *cache_lookup(const char *path, unsigned int variant);
+int cache_store(const char *path, unsigned int variant, const char *data, size_t length,
+                size_t header_length, const char *etag);
+void cache_invalidate(const char *path);
+void cache_flush(void);
+void cache_release(cache_object_t *object);
+size_t cache_stored_bytes(void);
+void cache_cleanup(void);
+
+#endif
@@ -10,7 +10,7 @@
 #define CONNECTION_POOL_SIZE 1000  
 
 #define BUFFER_SIZE 8192  
-#define BUFFER_POOL_SIZE 10000  
+#define BUFFER_POOL_SIZE 1024  
 #define SEND_BUFFER_SIZE 65536  
 #define RECV_BUFFER_SIZE 65536  
 
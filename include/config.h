@@ -7,6 +7,21 @@
 #include <string.h>
 #include <ctype.h>
 
+typedef enum {
+    EVENT_BACKEND_EPOLL = 0,
+    EVENT_BACKEND_IO_URING
+} event_backend_t;
+
+typedef enum {
+    LISTEN_MODE_REUSEPORT = 0,
+    LISTEN_MODE_EXCLUSIVE
+} listen_mode_t;
+
+typedef enum {
+    WORKER_MODE_PROCESSES = 0,
+    WORKER_MODE_THREADS
+} worker_mode_t;
+
 typedef struct {
     int port;
     int worker_count;
@@ -15,6 +30,25 @@ typedef struct {
     int max_connections;
     int keep_alive_timeout;
     int development_mode;
+    size_t cache_max_bytes;
+    int cache_size;
+    int cache_shared;
+    int cache_timeout;
+    int cache_watch;
+    int cache_warmup;
+    size_t cache_warmup_max_bytes;
+    int cache_warmup_max_files;
+    int open_file_cache_size;
+    int open_file_cache_valid;
+    int static_precompression;
+    event_backend_t event_backend;
+    listen_mode_t listen_mode;
+    int reuseport_cpu_steering;
+    worker_mode_t worker_mode;
+    int rate_limit_table_size;
+    int request_rate_limit;
+    int request_burst;
+    int rate_limit_ipv6_prefix;
 } config_t;
 
 void config_init(config_t *config);
@@ -0,0 +1,36 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <stddef.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "cache.h"
+
+#define FILECACHE_PROBE_LIMIT 8
+#define FILECACHE_LAST_MODIFIED_SIZE 32
+
+/*
+ * An open file together with the metadata every response for it needs.
+ * Entries are reference counted like cache objects: the descriptor stays
+ * open until the table and every in-flight response have released it, so
+ * sendfile() can keep using it after the entry has been replaced. All
+ * reads must use explicit offsets (pread/sendfile) since the descriptor
+ * is shared between connections.
+ */
+typedef struct file_info {
+    int refs;
+    int fd;
+    int symlinked;  // reached through a symlink, so kept out of both caches
+    struct stat st;
+    char etag[CACHE_ETAG_SIZE];
+    char last_modified[FILECACHE_LAST_MODIFIED_SIZE];
+} file_info_t;
+
+int filecache_init(size_t max_entries, time_t valid);
+file_info_t *filecache_open(const char *path);
+void filecache_release(file_info_t *info);
+void filecache_invalidate(const char *path);
+void filecache_flush(void);
+void filecache_cleanup(void);
+
+#endif
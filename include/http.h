@@ -3,6 +3,10 @@
 
 #include "log.h"
 #include "config.h"
+#include "cache.h"
+#include "filecache.h"
+#include "resolve.h"
+#include "scan.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,6 +15,7 @@
 #include <sys/stat.h>
 #include <sys/sendfile.h>
 #include <sys/socket.h>  
+#include <sys/uio.h>
 #include <netinet/in.h>  
 #include <netinet/tcp.h> 
 #include <errno.h>
@@ -27,11 +32,13 @@
 #define MAX_METHOD_SIZE 16
 #define MAX_REQUEST_SIZE (64 * 1024)
 #define MAX_HEADER_LINE_SIZE 8192
+#define MAX_CACHEABLE_FILE_SIZE (1024 * 1024)
 
 typedef enum {
     COMPRESSION_NONE = 0,
     COMPRESSION_GZIP,
-    COMPRESSION_DEFLATE
+    COMPRESSION_DEFLATE,
+    COMPRESSION_BROTLI
 } compression_type_t;
 
 #define COMPRESSION_LEVEL_DEFAULT 6
@@ -39,15 +46,62 @@ typedef enum {
 #define COMPRESSION_LEVEL_MAX 9
 #define COMPRESSION_LEVEL_NONE 0
 
+typedef enum {
+    HTTP_HEADER_HOST = 0,
+    HTTP_HEADER_CONNECTION,
+    HTTP_HEADER_ACCEPT_ENCODING,
+    HTTP_HEADER_IF_NONE_MATCH,
+    HTTP_HEADER_IF_MODIFIED_SINCE,
+    HTTP_HEADER_KNOWN_COUNT
+} http_known_header_t;
+
+// a range of the request buffer; nothing in a parsed request is copied or NUL-terminated
 typedef struct {
-    char method[MAX_METHOD_SIZE];
-    char uri[MAX_URI_SIZE];
-    char version[16];
-    char headers[MAX_HEADERS][2][MAX_HEADER_SIZE];
+    uint32_t offset;
+    uint32_t length;
+} http_slice_t;
+
+typedef struct {
+    http_slice_t name;
+    http_slice_t value;
+} http_header_t;
+
+typedef struct {
+    const char *buffer;
+    size_t length;  // request head including the blank line, set once parsing succeeds
+    http_slice_t method;
+    http_slice_t uri;
+    http_slice_t version;
+    http_header_t headers[MAX_HEADERS];
     int header_count;
+    int known[HTTP_HEADER_KNOWN_COUNT];
     int keep_alive;  
 } http_request_t;
 
+#define HTTP_SLICE_PTR(request, slice) ((request)->buffer + (slice).offset)
+
+typedef enum {
+    HTTP_PARSE_METHOD = 0,
+    HTTP_PARSE_URI,
+    HTTP_PARSE_VERSION,
+    HTTP_PARSE_HEADER_NAME,
+    HTTP_PARSE_HEADER_VALUE
+} http_parse_state_t;
+
+/*
+ * Progress through one request head. All positions are offsets from the
+ * start of the request, so the pending bytes may be moved between calls;
+ * each call continues from pos and never looks at a byte twice, except for
+ * a CR whose LF has not arrived yet.
+ */
+typedef struct {
+    http_parse_state_t state;
+    uint32_t pos;    // everything before pos has been scanned
+    uint32_t mark;   // start of the token or header line in progress
+    uint32_t colon;  // colon of the header line in progress
+    http_request_t request;
+} http_parser_t;
+
 typedef struct {
     int status_code;
     const char *status_text;
@@ -57,10 +111,10 @@ typedef struct {
     int is_file;
     int is_cached;
     int file_fd;
-    const char *cached_response;
+    file_info_t *file_info;
+    cache_object_t *cached_object;
     void *body;
     size_t body_length;
-    off_t file_offset;
     
     compression_type_t compression_type;
     void *compressed_body;
@@ -68,11 +122,54 @@ typedef struct {
     int compression_level;
 } http_response_t;
 
-int http_parse_request(const char *buffer, size_t length, http_request_t *request);
+#define HTTP_OUTPUT_QUEUE_SIZE 16
+
+/*
+ * A response reduced to what writing it takes: serialized headers and one
+ * body source, with progress so a send cut short by EAGAIN resumes at the
+ * exact byte. Headers are formatted into a staging area shared by the
+ * worker and only copied out for entries still unsent after a flush.
+ */
+typedef struct {
+    char *header_data;
+    size_t header_length;
+    size_t header_sent;
+    int header_owned;  // header_data was allocated for this entry
+    const char *body;
+    size_t body_length;
+    size_t body_sent;  // also the file offset for sendfile()
+    int file_fd;       // -1 unless the body is sent with sendfile()
+    file_info_t *file_info;
+    cache_object_t *cached_object;
+    void *owned_body;
+} http_output_t;
+
+// a header and a body for every entry a single gathered write can cover
+#define HTTP_OUTPUT_IOV_MAX (HTTP_OUTPUT_QUEUE_SIZE * 2)
+
+// responses of one connection in request order; entries before head have been written
+typedef struct {
+    http_output_t entries[HTTP_OUTPUT_QUEUE_SIZE];
+    int head;
+    int count;
+} http_output_queue_t;
+
+void http_parser_reset(http_parser_t *parser);
+int http_parse_request(http_parser_t *parser, const char *buffer, size_t length);
+const char *http_request_header(const http_request_t *request, http_known_header_t header, size_t *length);
 void http_create_response(http_response_t *response, int status_code);
 void http_add_header(http_response_t *response, const char *name, const char *value);
 int http_send_response(int client_fd, http_response_t *response);
+int http_output_push(http_output_queue_t *queue, http_response_t *response);
+int http_output_push_static(http_output_queue_t *queue, const char *data, size_t length);
+int http_output_flush(int client_fd, http_output_queue_t *queue);
+int http_output_gather(http_output_queue_t *queue, struct iovec *iov, int *more);
+void http_output_complete(http_output_queue_t *queue, size_t written);
+int http_output_send_file(int client_fd, http_output_queue_t *queue);
+int http_output_detach(http_output_queue_t *queue, char *area, size_t area_size);
+void http_output_clear(http_output_queue_t *queue);
 int http_serve_file(const char *path, http_response_t *response, const http_request_t *request);
+int http_preload_file(const char *path, compression_type_t type);
 const char *http_get_mime_type(const char *path);
 void http_free_response(http_response_t *response);
 int http_should_keep_alive(const http_request_t *request);
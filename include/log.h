@@ -19,16 +19,19 @@ typedef enum {
 
 int log_init(const char *filename);
 void log_set_level(log_level_t level);
+int log_enabled(log_level_t level);
 void log_message(log_level_t level, const char *format, ...);
 void log_access(const char *client_ip, const char *method, const char *uri, 
                 int status, long response_size);
 
 void log_cleanup(void);
 
-#define LOG_DEBUG(...) log_message(LOG_DEBUG, __VA_ARGS__)
-#define LOG_INFO(...)  log_message(LOG_INFO, __VA_ARGS__)
-#define LOG_WARN(...)  log_message(LOG_WARN, __VA_ARGS__)
-#define LOG_ERROR(...) log_message(LOG_ERROR, __VA_ARGS__)
-#define LOG_FATAL(...) log_message(LOG_FATAL, __VA_ARGS__)
+// arguments are only evaluated when the line is written, so they may format on demand
+#define LOG_AT(level, ...) do { if (log_enabled(level)) log_message(level, __VA_ARGS__); } while (0)
+#define LOG_DEBUG(...) LOG_AT(LOG_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_INFO, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_ERROR, __VA_ARGS__)
+#define LOG_FATAL(...) LOG_AT(LOG_FATAL, __VA_ARGS__)
 
 #endif 
\ No newline at end of file
@@ -8,6 +8,11 @@
 #include "config.h"
 #include "worker.h"
 #include "shutdown.h"
+#include "cache.h"
+#include "ratelimit.h"
+#include "watch.h"
+#include "warmup.h"
+#include "scan.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -21,6 +26,9 @@
 #include <errno.h>
 #include <netinet/tcp.h>
 #include <sched.h>
+#include <poll.h>
+#include <pthread.h>
+#include <linux/filter.h>
 
 
 #define MAX_WORKERS 32
@@ -28,6 +36,9 @@
 
 typedef struct {
     int server_fd;
+    int *listen_fds;  // socket each worker accepts on, indexed by worker id
+    int *steer_order; // worker id of each socket in SO_REUSEPORT group order, NULL unless steering
+    int steer_size;
     int port;
     int worker_count;
     int is_running;
@@ -0,0 +1,50 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#define RATE_LIMIT_WINDOW 60
+#define RATE_LIMIT_MAX_REQUESTS 100
+#define RATE_LIMIT_WAYS 8
+#define BAN_DURATION 300
+#define MAX_VIOLATIONS_BEFORE_BAN 3
+#define MAX_CONCURRENT_CONNECTIONS_PER_IP 10
+
+/*
+ * Per-client connection limiter shared by every worker. The master maps the
+ * bucket table before it forks, so limits hold across the whole server
+ * rather than per worker. Each bucket is updated with atomic operations
+ * only: a token bucket refilling RATE_LIMIT_MAX_REQUESTS per
+ * RATE_LIMIT_WINDOW, a second one charged for every request a connected
+ * client sends, a count of open connections and the ban state.
+ *
+ * Clients are keyed by their binary address, IPv4 in its v4-mapped IPv6
+ * form and IPv6 cut to its first ipv6_prefix bits, since one subscriber is
+ * usually handed a whole prefix to pick addresses from, and hashed to a set of RATE_LIMIT_WAYS buckets. A new client takes
+ * a free way or evicts the least recently seen one, preferring idle clients
+ * over connected ones and both over banned ones; a way whose client has
+ * been quiet long enough counts as free, so the table expires itself as it
+ * is used. Times are CLOCK_MONOTONIC milliseconds, which every process
+ * reads alike.
+ *
+ * Next to the buckets each worker has a row recording how many of every
+ * bucket's open connections it holds, so when a worker process dies the
+ * master hands its connections back with ratelimit_reclaim_worker().
+ */
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} ratelimit_key_t;
+
+int ratelimit_init(size_t entries, int workers, unsigned int requests_per_second, unsigned int request_burst,
+                   int ipv6_prefix);
+void ratelimit_set_worker(int worker_id);
+void ratelimit_reclaim_worker(int worker_id);
+void ratelimit_key(const struct sockaddr *addr, ratelimit_key_t *key);
+int ratelimit_acquire(const ratelimit_key_t *key, uint64_t now_ms);
+int ratelimit_request(const ratelimit_key_t *key, uint64_t now_ms);
+void ratelimit_release(const ratelimit_key_t *key);
+void ratelimit_cleanup(void);
+
+#endif
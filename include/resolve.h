@@ -0,0 +1,20 @@
+#ifndef RESOLVE_H
+#define RESOLVE_H
+
+#include <stddef.h>
+
+/*
+ * Request path resolution against a document root that is opened once.
+ * resolve_path() only normalizes the request path lexically into an
+ * absolute key under the canonical root; containment is enforced when the
+ * key is opened with resolve_open(), which uses openat2(RESOLVE_BENEATH)
+ * on the root descriptor or falls back to realpath() on older kernels.
+ * When symlinked is given it reports whether the path went through a
+ * symlink, since such a file is not under the key its contents belong to.
+ */
+int resolve_init(const char *root_dir);
+int resolve_path(const char *request_path, size_t length, char *path, size_t size);
+int resolve_open(const char *path, int flags, int *symlinked);
+void resolve_cleanup(void);
+
+#endif
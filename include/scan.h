@@ -0,0 +1,23 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+/*
+ * Byte classes the request parser stops at. Each scan walks forward until
+ * the first byte of the class, so a header line is covered exactly once:
+ * the name scan stops at the first byte that is not a token character
+ * (which must be the colon, validating the name on the way), and the value
+ * scan stops at CR or at a control character that is not allowed there.
+ */
+typedef enum {
+    SCAN_REQUEST_TOKEN,  // SP, DEL and all control characters
+    SCAN_HEADER_NAME,    // anything that is not an RFC 9110 tchar
+    SCAN_HEADER_VALUE,   // CR, LF, DEL and control characters other than HTAB
+    SCAN_CLASS_COUNT
+} scan_class_t;
+
+void scan_init(void);
+size_t scan_find(const char *buffer, size_t length, scan_class_t cls);
+
+#endif
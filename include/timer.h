@@ -0,0 +1,41 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+#define TIMER_WHEEL_SLOTS 256  // power of two
+#define TIMER_TICK_MS 250
+
+/*
+ * Hashed timing wheel driven by the event loop. Each id (a descriptor) owns
+ * at most one deadline, kept in the slot for its expiry tick; deadlines
+ * further out than one revolution share a slot with nearer ones and are
+ * skipped until their own tick comes round. Scheduling and cancelling only
+ * relink list entries, and the clock is read once per loop iteration with
+ * timer_wheel_update(), so no timer operation makes a system call.
+ */
+typedef struct {
+    int next;
+    int prev;
+    int list;       // slot the entry is linked into, TIMER_WHEEL_SLOTS when expired, -1 when idle
+    uint32_t tick;  // first tick at or after the deadline
+} timer_entry_t;
+
+typedef struct {
+    timer_entry_t *entries;  // indexed by id
+    int capacity;
+    int heads[TIMER_WHEEL_SLOTS + 1];  // the extra list holds deadlines that have passed
+    int count;
+    uint64_t now_ms;     // cached monotonic loop clock
+    uint32_t tick;       // last tick whose slot has been collected
+} timer_wheel_t;
+
+int timer_wheel_init(timer_wheel_t *wheel, int capacity);
+void timer_wheel_update(timer_wheel_t *wheel);
+void timer_wheel_schedule(timer_wheel_t *wheel, int id, uint64_t delay_ms);
+void timer_wheel_cancel(timer_wheel_t *wheel, int id);
+int timer_wheel_next_expired(timer_wheel_t *wheel);
+int timer_wheel_timeout(const timer_wheel_t *wheel, int max_ms);
+void timer_wheel_cleanup(timer_wheel_t *wheel);
+
+#endif
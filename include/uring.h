@@ -0,0 +1,70 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/*
+ * Minimal io_uring driver on the raw system calls. Requests are queued in
+ * the submission ring and only handed to the kernel by uring_wait(), which
+ * submits and waits for completions in one io_uring_enter(). Client sockets
+ * are installed in a sparse registered file table at the slot equal to
+ * their descriptor; the table is updated with queued requests as well, so
+ * registering a connection costs no system call of its own. Multishot
+ * receives pick their buffers from a single provided buffer ring that
+ * completions hand back with uring_buffer_return().
+ */
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+typedef struct {
+    int fd;
+    unsigned sq_entries;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_local_tail;  // includes entries not yet published to the kernel
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    void *cq_map;
+    size_t sq_map_size;
+    size_t cq_map_size;
+    size_t sqes_size;
+    int file_slots;
+    int *file_updates;       // descriptor each queued table update installs, indexed like sqes
+    struct io_uring_buf_ring *buffers;
+    char *buffer_memory;
+    unsigned buffer_count;
+    size_t buffer_size;
+    uint16_t buffer_tail;
+} uring_t;
+
+typedef struct {
+    uint64_t user_data;
+    int res;
+    int more;    // the request stays armed and completes again
+    int buffer;  // provided buffer holding res bytes, -1 if none
+} uring_completion_t;
+
+int uring_init(uring_t *ring, unsigned entries, int file_slots, unsigned buffer_count, size_t buffer_size);
+void uring_cleanup(uring_t *ring);
+int uring_register_fd(uring_t *ring, int fd);
+int uring_unregister_fd(uring_t *ring, int fd);
+int uring_accept(uring_t *ring, int fd, struct sockaddr *addr, socklen_t *addr_len, uint64_t user_data);
+int uring_recv_multishot(uring_t *ring, int fd, uint64_t user_data);
+int uring_sendmsg(uring_t *ring, int fd, const struct msghdr *msg, int flags, uint64_t user_data);
+int uring_poll(uring_t *ring, int fd, int fixed, uint32_t events, int multishot, uint64_t user_data);
+int uring_cancel(uring_t *ring, uint64_t user_data);
+int uring_wait(uring_t *ring, int timeout_ms);
+int uring_next(uring_t *ring, uring_completion_t *completion);
+const char *uring_buffer_data(uring_t *ring, int buffer);
+void uring_buffer_return(uring_t *ring, int buffer);
+
+#endif
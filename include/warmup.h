@@ -0,0 +1,13 @@
+#ifndef WARMUP_H
+#define WARMUP_H
+
+#include <stddef.h>
+
+/*
+ * Preloads the response cache from the document root before workers are
+ * forked, so every worker starts with the same hot cache. Returns the
+ * number of files loaded, or -1 if the root cannot be read.
+ */
+int warmup_run(const char *root_dir, size_t max_bytes, int max_files);
+
+#endif
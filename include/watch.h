@@ -0,0 +1,14 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+/*
+ * inotify watch over the document root. Each worker owns one instance and
+ * polls its descriptor from the event loop; every change reported for a
+ * file drops the cached responses and open file entry for that file's
+ * canonical path.
+ */
+int watch_init(const char *root_dir);
+void watch_handle_events(void);
+void watch_cleanup(void);
+
+#endif
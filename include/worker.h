@@ -2,10 +2,11 @@
 #define WORKER_H
 
 #include <sys/epoll.h>
-#include <sys/timerfd.h>
+#include <sys/resource.h>
 #include "log.h"
 #include "http.h"
 #include "config.h"
+#include "ratelimit.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,72 +21,128 @@
 #include <time.h>
 #include <sched.h>   
 #include <signal.h>  
+#include <poll.h>
 #include "shutdown.h"
 #include "common.h"
 #include "mempool.h"
+#include "watch.h"
+#include "timer.h"
+#include "uring.h"
 #include "http.h"  
 
 #define BUFFER_SIZE 8192
-#define BUFFER_POOL_SIZE 10000
+#define BUFFER_POOL_SIZE 1024
 #define MAX_CONNECTIONS 100000
 #define CONNECTION_POOL_SIZE 1000
 #define SEND_BUFFER_SIZE 65536
 #define RECV_BUFFER_SIZE 65536
-#define RATE_LIMIT_WINDOW 60  
-#define RATE_LIMIT_MAX_REQUESTS 100 
-#define RATE_LIMIT_TABLE_SIZE 1024
 
-#define BAN_DURATION 300 
-#define MAX_VIOLATIONS_BEFORE_BAN 3 
 #define SLOW_LORIS_TIMEOUT 10 
-#define MAX_CONCURRENT_CONNECTIONS_PER_IP 10 
+#define SEND_TIMEOUT 30
+#define URING_ENTRIES 1024
+#define URING_BUFFER_COUNT 1024  // power of two
+#define URING_BUFFER_SIZE 4096
+#define URING_ACCEPT_SLOTS 16    // accepts kept in flight, each with its own peer address
+#define URING_SEND_HEADERS 4096  // room for the headers of a batch before they spill to the heap
+
+typedef enum {
+    DEADLINE_NONE,
+    DEADLINE_IDLE,     // keep-alive wait for the next request
+    DEADLINE_REQUEST,  // a request head has started and must complete
+    DEADLINE_SEND      // a blocked response must make progress
+} client_deadline_t;
+
+// receive state, only held while a connection has bytes it has not answered yet
+typedef struct {
+    http_parser_t parser;  // progress through the request starting at buffer_consumed
+    char *spill;           // bytes io_uring delivered past what data could take while a response was blocked
+    size_t spill_length;
+    char data[BUFFER_SIZE];
+} client_input_t;
+
+// a batch io_uring is writing; the kernel reads msg, iov and the headers until the send completes
+typedef struct client_send {
+    http_output_queue_t queue;  // what client->output points at while the batch is out
+    struct msghdr msg;
+    struct iovec iov[HTTP_OUTPUT_IOV_MAX];
+    char headers[URING_SEND_HEADERS];  // the batch's headers, copied out of the shared staging area
+    uint64_t tag;               // the send still in flight after its connection closed
+    struct client_send *next;   // free or orphaned list
+} client_send_t;
+
+typedef struct {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+} uring_accept_t;
+
+/*
+ * Per-connection record. An idle keep-alive connection holds no buffers:
+ * input is taken from the pool on EPOLLIN and returned once every request
+ * in it has been answered, and output is only moved out of the worker's
+ * batch queue when a write blocks or, with io_uring, while the ring writes
+ * it.
+ */
+#define CLIENT_URING_RECV 0x1  // multishot receive armed
+#define CLIENT_URING_POLL 0x2  // waiting for the socket to become writable
+#define CLIENT_URING_SEND 0x4  // gathered write of client->send in flight
 
 typedef struct {
     int fd;
-    int timer_fd;  
-    time_t last_activity;  
-    char *buffer;  
-    int keep_alive;  
-    int has_pending_response;  
-    http_response_t pending_response;
-    time_t connection_start;
-    char client_ip[INET_ADDRSTRLEN];
+    uint32_t generation;   // tells io_uring completions for an earlier connection on this fd apart
+    int uring_pending;     // CLIENT_URING_* requests in flight
+    client_deadline_t deadline;  // which timeout the connection's timer wheel entry stands for
+    client_input_t *input;       // NULL while idle
+    http_output_queue_t *output; // responses still being written, NULL unless a write blocked
+    client_send_t *send;         // io_uring only: holds output while the ring writes it
+    size_t buffer_used;      // bytes received into input->data
+    size_t buffer_consumed;  // leading bytes of requests already answered
+    int keep_alive;
     int bytes_received;
+    time_t last_activity;
+    time_t connection_start;
+    struct sockaddr_storage client_addr;  // formatted only for log lines, see worker_client_address()
+    ratelimit_key_t rate_key;  // bucket the connection is counted in
 } client_conn_t;
 
 typedef struct {
     int epoll_fd;
     int server_fd;
+    int watch_fd;
     struct epoll_event *events;
     int is_running;
     int keep_alive_timeout;  
     client_conn_t *clients;  
     int client_count;
-    mempool_t buffer_pool;  
+    int *fd_table;      // fd -> index + 1 into clients, 0 if unused
+    int fd_table_size;
+    timer_wheel_t timers;  // one deadline per client fd
+    time_t now;            // monotonic loop clock in seconds, refreshed once per wakeup
+    uring_t *ring;          // NULL unless the io_uring backend is in use
+    uint32_t next_generation;
+    uring_accept_t *accepts;        // URING_ACCEPT_SLOTS address buffers
+    client_send_t *free_sends;
+    client_send_t *orphaned_sends;  // batches of closed connections the kernel may still be reading
+    mempool_t buffer_pool;  // client_input_t blocks
+    http_output_queue_t output;  // responses of the batch being written
     int cpu_id;  
+    int count_steering;             // compare each connection's receiving CPU with cpu_id
+    unsigned long steered_local;    // connections whose packets arrive on this worker's CPU
+    unsigned long steered_remote;
     int *connection_pool;  
     int pool_size;
     int pool_count;
 } worker_t;
 
-typedef struct {
-    char ip[INET_ADDRSTRLEN];
-    time_t window_start;
-    int request_count;
-    time_t last_request;
-    int violation_count;
-    time_t ban_until;
-    int connection_count;
-} rate_limit_entry_t;
-
 int worker_init(worker_t *worker, int server_fd, int cpu_id);
 
 void worker_run(worker_t *worker);
 void worker_cleanup(worker_t *worker);
-void worker_handle_connection(worker_t *worker, int client_fd);
+int worker_handle_connection(worker_t *worker, int client_fd, const struct sockaddr_storage *addr,
+                             const ratelimit_key_t *rate_key);
+const char *worker_client_address(const client_conn_t *client);
 void worker_handle_client_data(worker_t *worker, int client_fd);
 void worker_handle_client_write(worker_t *worker, int client_fd);
-void worker_handle_timeout(worker_t *worker, int timer_fd);
+void worker_handle_timeout(worker_t *worker, int client_fd);
 int worker_add_client(worker_t *worker, int client_fd);
 void worker_remove_client(worker_t *worker, int client_fd);
 
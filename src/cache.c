@@ -0,0 +1,754 @@
+#include "cache.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define CACHE_NIL (-1)
+#define CACHE_READ_RETRIES 3
+#define SHM_ALIGN(n) (((n) + 7) & ~(size_t)7)
+#define SHM_PIN_GRANULE 4096  // records starting in the same span of the log share a pin count
+
+typedef struct {
+    char *path;
+    uint32_t hash;
+    unsigned int variant;
+    cache_object_t *object;
+    size_t charge;
+    time_t timestamp;
+    uint64_t last_used;
+    int32_t lru_prev;
+    int32_t lru_next;
+} cache_entry_t;
+
+/*
+ * Shared mode keeps everything in one MAP_SHARED arena mapped by the master
+ * before it forks: a header, an open-addressed slot table, per-worker pin
+ * counts and a circular log holding the path and response bytes of every
+ * entry. Writers serialize on a robust process-shared mutex; readers never
+ * lock and validate what they read against the per-slot sequence counter
+ * instead. A hit pins the span of the log its record starts in and is sent
+ * straight from the arena; the log head never advances past a pinned
+ * record, so its bytes stay put until the handle is released.
+ */
+typedef struct {
+    uint32_t seq;
+    uint32_t hash;
+    uint32_t variant;
+    uint32_t path_len;
+    uint64_t record;
+    uint64_t length;
+    uint64_t header_length;
+    int64_t timestamp;
+    uint64_t last_used;
+    char etag[CACHE_ETAG_SIZE];
+} shm_slot_t;
+
+typedef struct {
+    uint32_t slot;
+    uint32_t seq;
+    uint64_t size;
+} shm_record_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t clock;
+    uint64_t head;
+    uint64_t tail;
+    uint64_t wrap;
+    uint64_t records;
+    int wrapped;
+    int reset_pending;  // the log restarts once nothing in it is pinned
+    size_t entry_count;
+} shm_header_t;
+
+typedef struct {
+    cache_entry_t *slots;
+    int shared;
+    shm_header_t *shm;
+    shm_slot_t *shm_slots;
+    uint32_t *shm_pins;  // pin_rows rows of one count per SHM_PIN_GRANULE of the log
+    size_t pin_cells;
+    int pin_rows;
+    char *shm_data;
+    size_t shm_data_size;
+    size_t shm_map_size;
+    uint32_t mask;
+    size_t max_bytes;
+    size_t max_entries;
+    time_t timeout;
+    size_t used_bytes;
+    size_t stored_bytes;  // taken by every store this process made, evicted since or not
+    size_t entry_count;
+    uint64_t clock;
+    int32_t lru_head;
+    int32_t lru_tail;
+} cache_t;
+
+static cache_t cache;
+static __thread int cache_worker = -1;
+
+// variants are deliberately left out of the hash so every encoding of a path
+// lands in the same probe window and can be invalidated together
+static uint32_t hash_path(const char *path) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int cache_expired(time_t timestamp) {
+    return cache.timeout > 0 && time(NULL) - timestamp >= cache.timeout;
+}
+
+static void lru_unlink(int32_t idx) {
+    cache_entry_t *entry = &cache.slots[idx];
+
+    if (entry->lru_prev != CACHE_NIL) {
+        cache.slots[entry->lru_prev].lru_next = entry->lru_next;
+    } else {
+        cache.lru_head = entry->lru_next;
+    }
+
+    if (entry->lru_next != CACHE_NIL) {
+        cache.slots[entry->lru_next].lru_prev = entry->lru_prev;
+    } else {
+        cache.lru_tail = entry->lru_prev;
+    }
+
+    entry->lru_prev = entry->lru_next = CACHE_NIL;
+}
+
+static void lru_push_front(int32_t idx) {
+    cache_entry_t *entry = &cache.slots[idx];
+
+    entry->lru_prev = CACHE_NIL;
+    entry->lru_next = cache.lru_head;
+    if (cache.lru_head != CACHE_NIL) {
+        cache.slots[cache.lru_head].lru_prev = idx;
+    }
+    cache.lru_head = idx;
+    if (cache.lru_tail == CACHE_NIL) {
+        cache.lru_tail = idx;
+    }
+    entry->last_used = ++cache.clock;
+}
+
+static void evict_slot(int32_t idx) {
+    cache_entry_t *entry = &cache.slots[idx];
+
+    if (!entry->path) {
+        return;
+    }
+
+    LOG_DEBUG("Cache evict: path='%s', variant=%u, bytes=%zu", entry->path, entry->variant, entry->charge);
+
+    lru_unlink(idx);
+    cache_release(entry->object);
+    free(entry->path);
+
+    cache.used_bytes -= entry->charge;
+    cache.entry_count--;
+    memset(entry, 0, sizeof(*entry));
+    entry->lru_prev = entry->lru_next = CACHE_NIL;
+}
+
+static int32_t find_slot(const char *path, unsigned int variant, uint32_t hash) {
+    for (uint32_t i = 0; i < CACHE_PROBE_LIMIT; i++) {
+        int32_t idx = (hash + i) & cache.mask;
+        cache_entry_t *entry = &cache.slots[idx];
+
+        if (entry->path && entry->hash == hash && entry->variant == variant &&
+            strcmp(entry->path, path) == 0) {
+            return idx;
+        }
+    }
+    return CACHE_NIL;
+}
+
+static void shm_slot_clear(shm_slot_t *slot) {
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    if (slot->path_len) {
+        cache.shm->entry_count--;
+    }
+    slot->path_len = 0;
+    slot->length = 0;
+    __atomic_store_n(&slot->seq, slot->seq + 1, __ATOMIC_RELEASE);
+}
+
+// drops every entry; the log itself is only rewound by shm_alloc() once no reader pins any of it
+static void shm_reset(void) {
+    for (uint32_t i = 0; i <= cache.mask; i++) {
+        shm_slot_clear(&cache.shm_slots[i]);
+    }
+    cache.shm->entry_count = 0;
+    cache.shm->reset_pending = 1;
+}
+
+static uint32_t *shm_pin_cell(int worker_id, uint64_t record) {
+    return &cache.shm_pins[(size_t)worker_id * cache.pin_cells + record / SHM_PIN_GRANULE];
+}
+
+static int shm_pinned(uint64_t record) {
+    for (int worker_id = 0; worker_id < cache.pin_rows; worker_id++) {
+        if (__atomic_load_n(shm_pin_cell(worker_id, record), __ATOMIC_ACQUIRE)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int shm_any_pinned(void) {
+    for (size_t i = 0; i < (size_t)cache.pin_rows * cache.pin_cells; i++) {
+        if (__atomic_load_n(&cache.shm_pins[i], __ATOMIC_ACQUIRE)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static void shm_lock(void) {
+    int rc = pthread_mutex_lock(&cache.shm->lock);
+    if (rc == EOWNERDEAD) {
+        LOG_WARN("Shared cache writer died while holding the lock, resetting cache");
+        shm_reset();
+        pthread_mutex_consistent(&cache.shm->lock);
+    }
+}
+
+static void shm_unlock(void) {
+    pthread_mutex_unlock(&cache.shm->lock);
+}
+
+// the slot may already have been replaced or invalidated; only clear it if it still owns the record
+static void shm_unlink_record(uint64_t record) {
+    shm_record_t *rec = (shm_record_t *)(cache.shm_data + record);
+    shm_slot_t *slot = &cache.shm_slots[rec->slot];
+    if (slot->path_len && slot->record == record && slot->seq == rec->seq) {
+        shm_slot_clear(slot);
+    }
+}
+
+// returns -1 while a reader still sends from the head record; its entry is dropped so no new reader pins it
+static int shm_evict_head(void) {
+    shm_header_t *hdr = cache.shm;
+    shm_record_t *rec = (shm_record_t *)(cache.shm_data + hdr->head);
+
+    shm_unlink_record(hdr->head);
+
+    // pairs with the fence in shm_lookup(): either the reader sees the slot change or we see its pin
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (shm_pinned(hdr->head)) {
+        // later records pinned through the same count would keep it raised, so they are dropped as well
+        uint64_t granule = hdr->head / SHM_PIN_GRANULE;
+        uint64_t end = hdr->wrapped ? hdr->wrap : hdr->tail;
+        for (uint64_t next = hdr->head + rec->size; next < end && next / SHM_PIN_GRANULE == granule;
+             next += ((shm_record_t *)(cache.shm_data + next))->size) {
+            shm_unlink_record(next);
+        }
+        return -1;
+    }
+
+    hdr->head += rec->size;
+    hdr->records--;
+    if (hdr->wrapped && hdr->head == hdr->wrap) {
+        hdr->head = 0;
+        hdr->wrapped = 0;
+    }
+    return 0;
+}
+
+static int64_t shm_alloc(size_t size) {
+    shm_header_t *hdr = cache.shm;
+
+    if (size > cache.shm_data_size) {
+        return -1;
+    }
+
+    if (hdr->reset_pending) {
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (shm_any_pinned()) {
+            return -1;
+        }
+        hdr->head = hdr->tail = hdr->wrap = 0;
+        hdr->records = 0;
+        hdr->wrapped = 0;
+        hdr->reset_pending = 0;
+    }
+
+    for (;;) {
+        if (hdr->records == 0) {
+            hdr->head = hdr->tail = 0;
+            hdr->wrapped = 0;
+        }
+
+        if (!hdr->wrapped) {
+            if (cache.shm_data_size - hdr->tail >= size) {
+                break;
+            }
+            hdr->wrap = hdr->tail;
+            hdr->wrapped = 1;
+            hdr->tail = 0;
+            continue;
+        }
+
+        if (hdr->head - hdr->tail >= size) {
+            break;
+        }
+        if (shm_evict_head() != 0) {
+            return -1;
+        }
+    }
+
+    int64_t offset = hdr->tail;
+    hdr->tail += size;
+    hdr->records++;
+    return offset;
+}
+
+static int shm_init(size_t max_bytes, uint32_t capacity, int workers) {
+    size_t header_size = SHM_ALIGN(sizeof(shm_header_t));
+    size_t slots_size = SHM_ALIGN(sizeof(shm_slot_t) * capacity);
+    size_t pin_cells = (max_bytes + SHM_PIN_GRANULE - 1) / SHM_PIN_GRANULE;
+    size_t pins_size = SHM_ALIGN(sizeof(uint32_t) * pin_cells * workers);
+    size_t map_size = header_size + slots_size + pins_size + max_bytes;
+
+    void *arena = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED) {
+        LOG_ERROR("Failed to map shared response cache (%zu bytes): %s", map_size, strerror(errno));
+        return -1;
+    }
+
+    cache.shm = arena;
+    cache.shm_slots = (shm_slot_t *)((char *)arena + header_size);
+    cache.shm_pins = (uint32_t *)((char *)arena + header_size + slots_size);
+    cache.pin_cells = pin_cells;
+    cache.pin_rows = workers;
+    cache.shm_data = (char *)arena + header_size + slots_size + pins_size;
+    cache.shm_data_size = max_bytes;
+    cache.shm_map_size = map_size;
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    if (pthread_mutex_init(&cache.shm->lock, &attr) != 0) {
+        LOG_ERROR("Failed to initialize shared cache mutex");
+        pthread_mutexattr_destroy(&attr);
+        munmap(arena, map_size);
+        cache.shm = NULL;
+        return -1;
+    }
+    pthread_mutexattr_destroy(&attr);
+
+    return 0;
+}
+
+static cache_object_t *shm_lookup(const char *path, unsigned int variant, uint32_t hash) {
+    size_t path_len = strlen(path);
+
+    for (uint32_t i = 0; i < CACHE_PROBE_LIMIT; i++) {
+        shm_slot_t *slot = &cache.shm_slots[(hash + i) & cache.mask];
+
+        for (int attempt = 0; attempt < CACHE_READ_RETRIES; attempt++) {
+            uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+            if (seq & 1) {
+                continue;
+            }
+
+            uint64_t record = slot->record;
+            uint64_t length = slot->length;
+            uint64_t header_length = slot->header_length;
+            int64_t timestamp = slot->timestamp;
+            if (slot->path_len != path_len || slot->hash != hash || slot->variant != variant ||
+                record + sizeof(shm_record_t) + path_len + length > cache.shm_data_size) {
+                break;
+            }
+
+            const char *payload = cache.shm_data + record + sizeof(shm_record_t);
+            if (memcmp(payload, path, path_len) != 0 || cache_expired(timestamp)) {
+                if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) == seq) {
+                    break;
+                }
+                continue;
+            }
+
+            // a thread without a pin row (the master) gets a private copy instead
+            uint32_t *pin = cache_worker >= 0 ? shm_pin_cell(cache_worker, record) : NULL;
+            cache_object_t *object = malloc(sizeof(cache_object_t) + (pin ? 0 : length));
+            if (!object) {
+                LOG_ERROR("Failed to allocate memory for shared cache hit");
+                return NULL;
+            }
+            memcpy(object->etag, slot->etag, sizeof(object->etag));
+            if (pin) {
+                __atomic_add_fetch(pin, 1, __ATOMIC_RELAXED);
+                object->data = payload + path_len;
+            } else {
+                memcpy(object->storage, payload + path_len, length);
+                object->data = object->storage;
+            }
+
+            // pairs with the fence in shm_evict_head(): a record still owned by the slot cannot be reused now
+            __atomic_thread_fence(pin ? __ATOMIC_SEQ_CST : __ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq) {
+                if (pin) {
+                    __atomic_sub_fetch(pin, 1, __ATOMIC_RELEASE);
+                }
+                free(object);
+                continue;
+            }
+
+            object->pin = pin;
+            object->refs = 1;
+            object->length = length;
+            object->header_length = header_length < length ? header_length : length;
+            object->etag[sizeof(object->etag) - 1] = '\0';
+            __atomic_store_n(&slot->last_used, __atomic_add_fetch(&cache.shm->clock, 1, __ATOMIC_RELAXED),
+                             __ATOMIC_RELAXED);
+            return object;
+        }
+    }
+
+    return NULL;
+}
+
+static int shm_store(const char *path, unsigned int variant, uint32_t hash,
+                     const char *data, size_t length, size_t header_length, const char *etag) {
+    size_t path_len = strlen(path);
+    size_t size = SHM_ALIGN(sizeof(shm_record_t) + path_len + length);
+    if (size > cache.shm_data_size) {
+        LOG_DEBUG("Response for %s too large to cache (%zu bytes)", path, length);
+        return -1;
+    }
+
+    shm_lock();
+
+    // take a matching or free slot in the probe window, otherwise the least recently used one
+    shm_slot_t *victim = NULL;
+    for (uint32_t i = 0; i < CACHE_PROBE_LIMIT; i++) {
+        shm_slot_t *slot = &cache.shm_slots[(hash + i) & cache.mask];
+        if (slot->path_len == path_len && slot->hash == hash && slot->variant == variant &&
+            memcmp(cache.shm_data + slot->record + sizeof(shm_record_t), path, path_len) == 0) {
+            victim = slot;
+            break;
+        }
+        if (!slot->path_len) {
+            if (!victim || victim->path_len) {
+                victim = slot;
+            }
+        } else if (!victim || (victim->path_len && slot->last_used < victim->last_used)) {
+            victim = slot;
+        }
+    }
+    shm_slot_clear(victim);
+
+    // a pinned head still drops its entry, which is all the entry limit needs
+    while (cache.shm->entry_count >= cache.max_entries && cache.shm->records > 0 && !cache.shm->reset_pending) {
+        if (shm_evict_head() != 0) {
+            break;
+        }
+    }
+
+    int64_t offset = shm_alloc(size);
+    if (offset < 0) {
+        shm_unlock();
+        return -1;
+    }
+
+    uint32_t seq = victim->seq + 1;
+    __atomic_store_n(&victim->seq, seq, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    shm_record_t *rec = (shm_record_t *)(cache.shm_data + offset);
+    rec->slot = (uint32_t)(victim - cache.shm_slots);
+    rec->seq = seq + 1;
+    rec->size = size;
+    memcpy(cache.shm_data + offset + sizeof(shm_record_t), path, path_len);
+    memcpy(cache.shm_data + offset + sizeof(shm_record_t) + path_len, data, length);
+
+    victim->hash = hash;
+    victim->variant = variant;
+    victim->path_len = path_len;
+    victim->record = offset;
+    victim->length = length;
+    victim->header_length = header_length;
+    victim->timestamp = time(NULL);
+    victim->last_used = __atomic_add_fetch(&cache.shm->clock, 1, __ATOMIC_RELAXED);
+    strncpy(victim->etag, etag ? etag : "", sizeof(victim->etag) - 1);
+    victim->etag[sizeof(victim->etag) - 1] = '\0';
+    cache.shm->entry_count++;
+    cache.stored_bytes += size;
+
+    __atomic_store_n(&victim->seq, seq + 1, __ATOMIC_RELEASE);
+
+    shm_unlock();
+
+    LOG_DEBUG("Cached response for %s in shared cache (variant %u, %zu bytes)", path, variant, length);
+    return 0;
+}
+
+int cache_init(size_t max_bytes, size_t max_entries, time_t timeout, int shared, int workers) {
+    if (max_bytes == 0) {
+        max_bytes = CACHE_DEFAULT_MAX_BYTES;
+    }
+    if (max_entries == 0) {
+        max_entries = CACHE_DEFAULT_MAX_ENTRIES;
+    }
+
+    // keep the load factor at or below 50% so bounded probing rarely has to evict
+    uint32_t capacity = 16;
+    while (capacity < max_entries * 2 && capacity < (1u << 30)) {
+        capacity <<= 1;
+    }
+
+    cache.mask = capacity - 1;
+    cache.max_bytes = max_bytes;
+    cache.max_entries = max_entries;
+    cache.timeout = timeout;
+
+    if (shared) {
+        if (shm_init(SHM_ALIGN(max_bytes), capacity, workers > 0 ? workers : 1) != 0) {
+            return -1;
+        }
+        cache.shared = 1;
+        LOG_INFO("Shared response cache initialized: %zu bytes, %zu entries, %u slots",
+                 max_bytes, max_entries, capacity);
+        return 0;
+    }
+
+    cache.slots = calloc(capacity, sizeof(cache_entry_t));
+    if (!cache.slots) {
+        LOG_ERROR("Failed to allocate response cache table (%u slots)", capacity);
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < capacity; i++) {
+        cache.slots[i].lru_prev = cache.slots[i].lru_next = CACHE_NIL;
+    }
+
+    cache.used_bytes = 0;
+    cache.entry_count = 0;
+    cache.clock = 0;
+    cache.lru_head = cache.lru_tail = CACHE_NIL;
+
+    LOG_INFO("Response cache initialized: %zu bytes, %zu entries, %u slots",
+             max_bytes, max_entries, capacity);
+
+    return 0;
+}
+
+cache_object_t *cache_lookup(const char *path, unsigned int variant) {
+    if (cache.shared) {
+        cache_object_t *object = shm_lookup(path, variant, hash_path(path));
+        LOG_DEBUG("Shared cache %s for %s (variant %u)", object ? "hit" : "miss", path, variant);
+        return object;
+    }
+
+    if (!cache.slots) {
+        return NULL;
+    }
+
+    uint32_t hash = hash_path(path);
+    int32_t idx = find_slot(path, variant, hash);
+    if (idx == CACHE_NIL) {
+        LOG_DEBUG("Cache miss for %s (variant %u)", path, variant);
+        return NULL;
+    }
+
+    cache_entry_t *entry = &cache.slots[idx];
+    if (cache_expired(entry->timestamp)) {
+        LOG_DEBUG("Cache entry expired for %s (variant %u)", path, variant);
+        evict_slot(idx);
+        return NULL;
+    }
+
+    lru_unlink(idx);
+    lru_push_front(idx);
+
+    entry->object->refs++;
+    LOG_DEBUG("Cache hit for %s (variant %u)", path, variant);
+    return entry->object;
+}
+
+int cache_store(const char *path, unsigned int variant, const char *data, size_t length,
+                size_t header_length, const char *etag) {
+    if (cache.shared) {
+        return shm_store(path, variant, hash_path(path), data, length, header_length, etag);
+    }
+
+    if (!cache.slots) {
+        return -1;
+    }
+
+    size_t path_len = strlen(path);
+    size_t charge = sizeof(cache_object_t) + length + path_len + 1;
+    if (charge > cache.max_bytes) {
+        LOG_DEBUG("Response for %s too large to cache (%zu bytes)", path, length);
+        return -1;
+    }
+
+    uint32_t hash = hash_path(path);
+    int32_t idx = find_slot(path, variant, hash);
+    if (idx != CACHE_NIL) {
+        evict_slot(idx);
+    }
+
+    while (cache.lru_tail != CACHE_NIL &&
+           (cache.used_bytes + charge > cache.max_bytes || cache.entry_count >= cache.max_entries)) {
+        evict_slot(cache.lru_tail);
+    }
+
+    // take the first free slot in the probe window, otherwise the least recently used one
+    int32_t victim = CACHE_NIL;
+    for (uint32_t i = 0; i < CACHE_PROBE_LIMIT; i++) {
+        int32_t candidate = (hash + i) & cache.mask;
+        if (!cache.slots[candidate].path) {
+            victim = candidate;
+            break;
+        }
+        if (victim == CACHE_NIL || cache.slots[candidate].last_used < cache.slots[victim].last_used) {
+            victim = candidate;
+        }
+    }
+    evict_slot(victim);
+
+    cache_object_t *object = malloc(sizeof(cache_object_t) + length);
+    char *path_copy = malloc(path_len + 1);
+    if (!object || !path_copy) {
+        LOG_ERROR("Failed to allocate memory for cached response");
+        free(object);
+        free(path_copy);
+        return -1;
+    }
+
+    object->refs = 1;
+    object->length = length;
+    object->header_length = header_length;
+    object->pin = NULL;
+    strncpy(object->etag, etag ? etag : "", sizeof(object->etag) - 1);
+    object->etag[sizeof(object->etag) - 1] = '\0';
+    memcpy(object->storage, data, length);
+    object->data = object->storage;
+    memcpy(path_copy, path, path_len + 1);
+
+    cache_entry_t *entry = &cache.slots[victim];
+    entry->path = path_copy;
+    entry->hash = hash;
+    entry->variant = variant;
+    entry->object = object;
+    entry->charge = charge;
+    entry->timestamp = time(NULL);
+    lru_push_front(victim);
+
+    cache.used_bytes += charge;
+    cache.stored_bytes += charge;
+    cache.entry_count++;
+
+    LOG_DEBUG("Cached response for %s (variant %u, %zu bytes, %zu/%zu bytes used)",
+              path, variant, length, cache.used_bytes, cache.max_bytes);
+
+    return 0;
+}
+
+void cache_invalidate(const char *path) {
+    uint32_t hash = hash_path(path);
+
+    if (cache.shared) {
+        size_t path_len = strlen(path);
+
+        shm_lock();
+        for (uint32_t i = 0; i < CACHE_PROBE_LIMIT; i++) {
+            shm_slot_t *slot = &cache.shm_slots[(hash + i) & cache.mask];
+            if (slot->path_len == path_len && slot->hash == hash &&
+                memcmp(cache.shm_data + slot->record + sizeof(shm_record_t), path, path_len) == 0) {
+                LOG_DEBUG("Shared cache invalidate: path='%s', variant=%u", path, slot->variant);
+                shm_slot_clear(slot);
+            }
+        }
+        shm_unlock();
+        return;
+    }
+
+    if (!cache.slots) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < CACHE_PROBE_LIMIT; i++) {
+        int32_t idx = (hash + i) & cache.mask;
+        cache_entry_t *entry = &cache.slots[idx];
+        if (entry->path && entry->hash == hash && strcmp(entry->path, path) == 0) {
+            evict_slot(idx);
+        }
+    }
+}
+
+void cache_flush(void) {
+    if (cache.shared) {
+        shm_lock();
+        shm_reset();
+        shm_unlock();
+        return;
+    }
+
+    if (!cache.slots) {
+        return;
+    }
+
+    while (cache.lru_tail != CACHE_NIL) {
+        evict_slot(cache.lru_tail);
+    }
+}
+
+void cache_release(cache_object_t *object) {
+    if (object && --object->refs == 0) {
+        if (object->pin) {
+            __atomic_sub_fetch(object->pin, 1, __ATOMIC_RELEASE);
+        }
+        free(object);
+    }
+}
+
+// lets a caller measure what its stores cost, headers and bookkeeping included
+size_t cache_stored_bytes(void) {
+    return cache.stored_bytes;
+}
+
+// the calling thread pins shared cache hits in worker_id's row; call it in each worker before it serves
+void cache_set_worker(int worker_id) {
+    cache_worker = worker_id >= 0 && worker_id < cache.pin_rows ? worker_id : -1;
+}
+
+// drops the pins of a dead worker so the log can move past what it was sending; only call it once it is gone
+void cache_reclaim_worker(int worker_id) {
+    if (!cache.shm || worker_id < 0 || worker_id >= cache.pin_rows) {
+        return;
+    }
+    for (size_t i = 0; i < cache.pin_cells; i++) {
+        __atomic_store_n(&cache.shm_pins[(size_t)worker_id * cache.pin_cells + i], 0, __ATOMIC_RELEASE);
+    }
+}
+
+void cache_cleanup(void) {
+    if (cache.shared) {
+        munmap(cache.shm, cache.shm_map_size);
+        memset(&cache, 0, sizeof(cache));
+        return;
+    }
+
+    if (!cache.slots) {
+        return;
+    }
+
+    while (cache.lru_tail != CACHE_NIL) {
+        evict_slot(cache.lru_tail);
+    }
+
+    free(cache.slots);
+    memset(&cache, 0, sizeof(cache));
+}
@@ -15,6 +15,25 @@ void config_init(config_t *config) {
     config->max_connections = 10000;
     config->keep_alive_timeout = 60;
     config->development_mode = 0;
+    config->cache_max_bytes = 64 * 1024 * 1024;
+    config->cache_size = 10000;
+    config->cache_shared = 0;
+    config->cache_timeout = 3600;
+    config->cache_watch = 1;
+    config->cache_warmup = 0;
+    config->cache_warmup_max_bytes = 16 * 1024 * 1024;
+    config->cache_warmup_max_files = 1000;
+    config->open_file_cache_size = 1000;
+    config->open_file_cache_valid = 60;
+    config->static_precompression = 0;
+    config->event_backend = EVENT_BACKEND_EPOLL;
+    config->listen_mode = LISTEN_MODE_REUSEPORT;
+    config->reuseport_cpu_steering = 0;
+    config->worker_mode = WORKER_MODE_PROCESSES;
+    config->rate_limit_table_size = 16384;
+    config->request_rate_limit = 100;
+    config->request_burst = 200;
+    config->rate_limit_ipv6_prefix = 64;
 }
 
 static void trim_whitespace(char *str) {
@@ -54,6 +73,44 @@ static int parse_config_line(config_t *config, const char *line) {
         config->keep_alive_timeout = atoi(value);
     } else if (strcmp(key, "development_mode") == 0) {
         config->development_mode = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+    } else if (strcmp(key, "cache_max_bytes") == 0) {
+        config->cache_max_bytes = strtoull(value, NULL, 10);
+    } else if (strcmp(key, "cache_size") == 0) {
+        config->cache_size = atoi(value);
+    } else if (strcmp(key, "cache_shared") == 0) {
+        config->cache_shared = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+    } else if (strcmp(key, "cache_timeout") == 0) {
+        config->cache_timeout = atoi(value);
+    } else if (strcmp(key, "cache_watch") == 0) {
+        config->cache_watch = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+    } else if (strcmp(key, "cache_warmup") == 0) {
+        config->cache_warmup = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+    } else if (strcmp(key, "cache_warmup_max_bytes") == 0) {
+        config->cache_warmup_max_bytes = strtoull(value, NULL, 10);
+    } else if (strcmp(key, "cache_warmup_max_files") == 0) {
+        config->cache_warmup_max_files = atoi(value);
+    } else if (strcmp(key, "open_file_cache_size") == 0) {
+        config->open_file_cache_size = atoi(value);
+    } else if (strcmp(key, "open_file_cache_valid") == 0) {
+        config->open_file_cache_valid = atoi(value);
+    } else if (strcmp(key, "static_precompression") == 0) {
+        config->static_precompression = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+    } else if (strcmp(key, "event_backend") == 0) {
+        config->event_backend = strcmp(value, "io_uring") == 0 ? EVENT_BACKEND_IO_URING : EVENT_BACKEND_EPOLL;
+    } else if (strcmp(key, "listen_mode") == 0) {
+        config->listen_mode = strcmp(value, "exclusive") == 0 ? LISTEN_MODE_EXCLUSIVE : LISTEN_MODE_REUSEPORT;
+    } else if (strcmp(key, "reuseport_cpu_steering") == 0) {
+        config->reuseport_cpu_steering = (strcmp(value, "true") == 0 || strcmp(value, "1") == 0);
+    } else if (strcmp(key, "worker_mode") == 0) {
+        config->worker_mode = strcmp(value, "threads") == 0 ? WORKER_MODE_THREADS : WORKER_MODE_PROCESSES;
+    } else if (strcmp(key, "rate_limit_table_size") == 0) {
+        config->rate_limit_table_size = atoi(value);
+    } else if (strcmp(key, "request_rate_limit") == 0) {
+        config->request_rate_limit = atoi(value);
+    } else if (strcmp(key, "request_burst") == 0) {
+        config->request_burst = atoi(value);
+    } else if (strcmp(key, "rate_limit_ipv6_prefix") == 0) {
+        config->rate_limit_ipv6_prefix = atoi(value);
     }
 
     return 0;
@@ -0,0 +1,237 @@
+#include "filecache.h"
+#include "resolve.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+
+typedef struct {
+    char *path;
+    uint32_t hash;
+    file_info_t *info;
+    time_t validated;
+    uint64_t last_used;
+} filecache_entry_t;
+
+typedef struct {
+    filecache_entry_t *slots;
+    uint32_t mask;
+    time_t valid;
+    uint64_t clock;
+} filecache_t;
+
+// one per worker, which is a thread in worker_mode=threads
+static __thread filecache_t filecache;
+
+static uint32_t hash_path(const char *path) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void format_etag(const char *path, const struct stat *st, char *etag, size_t size) {
+    char etag_input[PATH_MAX + 128];
+    int written = snprintf(etag_input, sizeof(etag_input), "%s:%lu:%lu:%lu",
+                           path, (unsigned long)st->st_ino,
+                           (unsigned long)st->st_size, (unsigned long)st->st_mtime);
+    if (written >= (int)sizeof(etag_input)) {
+        etag_input[sizeof(etag_input) - 1] = '\0';
+    }
+
+    unsigned long hash = 5381;
+    for (char *p = etag_input; *p; p++) {
+        hash = ((hash << 5) + hash) + *p;
+    }
+
+    snprintf(etag, size, "\"%lx\"", hash);
+}
+
+static int same_file(const struct stat *a, const struct stat *b) {
+    return a->st_dev == b->st_dev && a->st_ino == b->st_ino && a->st_size == b->st_size &&
+           a->st_mtim.tv_sec == b->st_mtim.tv_sec && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+}
+
+static void evict_slot(filecache_entry_t *entry) {
+    if (!entry->path) {
+        return;
+    }
+
+    LOG_DEBUG("File cache evict: %s", entry->path);
+    filecache_release(entry->info);
+    free(entry->path);
+    memset(entry, 0, sizeof(*entry));
+}
+
+static filecache_entry_t *find_slot(const char *path, uint32_t hash) {
+    for (uint32_t i = 0; i < FILECACHE_PROBE_LIMIT; i++) {
+        filecache_entry_t *entry = &filecache.slots[(hash + i) & filecache.mask];
+        if (entry->path && entry->hash == hash && strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static file_info_t *open_file(const char *path) {
+    int symlinked;
+    int fd = resolve_open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC, &symlinked);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    file_info_t *info = malloc(sizeof(file_info_t));
+    if (!info) {
+        LOG_ERROR("Failed to allocate file cache entry for %s", path);
+        close(fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    if (fstat(fd, &info->st) == -1) {
+        int saved_errno = errno;
+        free(info);
+        close(fd);
+        errno = saved_errno;
+        return NULL;
+    }
+
+    info->refs = 1;
+    info->fd = fd;
+    info->symlinked = symlinked;
+    format_etag(path, &info->st, info->etag, sizeof(info->etag));
+
+    struct tm tm_info;
+    gmtime_r(&info->st.st_mtime, &tm_info);
+    strftime(info->last_modified, sizeof(info->last_modified), "%a, %d %b %Y %H:%M:%S GMT", &tm_info);
+
+    return info;
+}
+
+int filecache_init(size_t max_entries, time_t valid) {
+    filecache_cleanup();
+
+    if (max_entries == 0) {
+        LOG_INFO("Open file cache disabled");
+        return 0;
+    }
+
+    uint32_t capacity = FILECACHE_PROBE_LIMIT;
+    while (capacity < max_entries && capacity < (1u << 24)) {
+        capacity <<= 1;
+    }
+
+    filecache.slots = calloc(capacity, sizeof(filecache_entry_t));
+    if (!filecache.slots) {
+        LOG_ERROR("Failed to allocate open file cache (%u slots)", capacity);
+        return -1;
+    }
+
+    filecache.mask = capacity - 1;
+    filecache.valid = valid;
+    filecache.clock = 0;
+
+    LOG_INFO("Open file cache initialized: %u slots, revalidated every %lds", capacity, (long)valid);
+    return 0;
+}
+
+file_info_t *filecache_open(const char *path) {
+    if (!filecache.slots) {
+        return open_file(path);
+    }
+
+    uint32_t hash = hash_path(path);
+    filecache_entry_t *entry = find_slot(path, hash);
+    time_t now = time(NULL);
+
+    if (entry && now - entry->validated >= filecache.valid) {
+        // the file may have been replaced behind our back; keep the descriptor only if it is still the same file
+        struct stat st;
+        if (stat(path, &st) == 0 && same_file(&st, &entry->info->st)) {
+            entry->validated = now;
+        } else {
+            evict_slot(entry);
+            entry = NULL;
+        }
+    }
+
+    if (entry) {
+        entry->last_used = ++filecache.clock;
+        entry->info->refs++;
+        return entry->info;
+    }
+
+    file_info_t *info = open_file(path);
+    if (!info || info->symlinked) {
+        return info;
+    }
+
+    char *path_copy = strdup(path);
+    if (!path_copy) {
+        return info;
+    }
+
+    // take the first free slot in the probe window, otherwise the least recently used one
+    filecache_entry_t *victim = NULL;
+    for (uint32_t i = 0; i < FILECACHE_PROBE_LIMIT; i++) {
+        filecache_entry_t *candidate = &filecache.slots[(hash + i) & filecache.mask];
+        if (!candidate->path) {
+            victim = candidate;
+            break;
+        }
+        if (!victim || candidate->last_used < victim->last_used) {
+            victim = candidate;
+        }
+    }
+    evict_slot(victim);
+
+    victim->path = path_copy;
+    victim->hash = hash;
+    victim->info = info;
+    victim->validated = now;
+    victim->last_used = ++filecache.clock;
+    info->refs++;
+
+    return info;
+}
+
+void filecache_release(file_info_t *info) {
+    if (info && --info->refs == 0) {
+        close(info->fd);
+        free(info);
+    }
+}
+
+void filecache_invalidate(const char *path) {
+    if (!filecache.slots) {
+        return;
+    }
+
+    filecache_entry_t *entry = find_slot(path, hash_path(path));
+    if (entry) {
+        evict_slot(entry);
+    }
+}
+
+void filecache_flush(void) {
+    if (!filecache.slots) {
+        return;
+    }
+
+    for (uint32_t i = 0; i <= filecache.mask; i++) {
+        evict_slot(&filecache.slots[i]);
+    }
+}
+
+void filecache_cleanup(void) {
+    filecache_flush();
+    free(filecache.slots);
+    memset(&filecache, 0, sizeof(filecache));
+}
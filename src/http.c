@@ -35,254 +35,271 @@ static const struct {
     {NULL, "application/octet-stream"}
 };
 
-#define CACHE_SIZE 10000    
-#define CACHE_TIMEOUT 3600      
+// headers of the batch being assembled; empty again after every http_output_flush()
+static __thread char header_buffer[HTTP_OUTPUT_QUEUE_SIZE * 1024];
+static __thread size_t header_buffer_used;
 
-static char header_buffer[8192];
+static const struct {
+    const char *name;
+    size_t length;
+} known_headers[HTTP_HEADER_KNOWN_COUNT] = {
+    [HTTP_HEADER_HOST] = {"Host", 4},
+    [HTTP_HEADER_CONNECTION] = {"Connection", 10},
+    [HTTP_HEADER_ACCEPT_ENCODING] = {"Accept-Encoding", 15},
+    [HTTP_HEADER_IF_NONE_MATCH] = {"If-None-Match", 13},
+    [HTTP_HEADER_IF_MODIFIED_SINCE] = {"If-Modified-Since", 17},
+};
 
-static unsigned int hash_key(const char *key) {
-    unsigned int hash = 5381;
-    int c;
-    while ((c = *key++)) {
-        hash = ((hash << 5) + hash) + c;
-    }
-    return hash % CACHE_SIZE;
+static const char *valid_methods[] = {
+    "GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS", "TRACE", "PATCH", NULL
+};
+
+static int slice_equals(const http_request_t *request, http_slice_t slice, const char *text) {
+    size_t len = strlen(text);
+    return slice.length == len && memcmp(HTTP_SLICE_PTR(request, slice), text, len) == 0;
 }
 
-typedef struct {
-    char path[PATH_MAX];
-    char *response;
-    size_t response_len;
-    time_t timestamp;
-    char vary_key[256];
-    char etag[64];
-} cache_entry_t;
+static int slice_equals_nocase(const http_request_t *request, http_slice_t slice, const char *text) {
+    size_t len = strlen(text);
+    return slice.length == len && strncasecmp(HTTP_SLICE_PTR(request, slice), text, len) == 0;
+}
 
-static cache_entry_t response_cache[CACHE_SIZE];
-static int cache_index = 0;
+// bytes ran out before the blank line: wait for more unless the head is already too large
+static int parse_incomplete(size_t length) {
+    if (length > MAX_REQUEST_SIZE) {
+        LOG_WARN("Request too large: %zu bytes (max: %d)", length, MAX_REQUEST_SIZE);
+        return -2;  // Oversized request
+    }
+    return -4;  // Incomplete request
+}
 
-static void generate_vary_key(const char *path, const http_request_t *request, char *key, size_t key_size) {
-    if (!request) {
-        strncpy(key, path, key_size - 1);
-        key[key_size - 1] = '\0';
-        return;
+static int validate_request_line(const http_request_t *request) {
+    if (request->method.length >= MAX_METHOD_SIZE || request->uri.length >= MAX_URI_SIZE) {
+        LOG_WARN("Request line too long");
+        return -1;
     }
     
-    snprintf(key, key_size, "%s:", path);
-    
-    for (int i = 0; i < request->header_count; i++) {
-        if (strcasecmp(request->headers[i][0], "Accept-Encoding") == 0) {
-            size_t current_len = strlen(key);
-            const char *encoding = request->headers[i][1];
-            if (strstr(encoding, "gzip")) {
-                snprintf(key + current_len, key_size - current_len, "gzip");
-            } else if (strstr(encoding, "deflate")) {
-                snprintf(key + current_len, key_size - current_len, "deflate");
-            } else {
-                snprintf(key + current_len, key_size - current_len, "none");
-            }
-            break;
-        }
+    // Security: Validate HTTP version
+    if (!slice_equals(request, request->version, "HTTP/1.0") && 
+        !slice_equals(request, request->version, "HTTP/1.1")) {
+        LOG_WARN("Unsupported HTTP version: %.*s", (int)request->version.length, 
+                 HTTP_SLICE_PTR(request, request->version));
+        return -3;  // Unsupported version
     }
     
-    if (strchr(key, ':') && key[strlen(key)-1] == ':') {
-        size_t current_len = strlen(key);
-        if (current_len + 4 < key_size) {  // "none" is 4 chars + null terminator
-            snprintf(key + current_len, key_size - current_len, "none");
+    // Security: Validate method
+    for (int i = 0; valid_methods[i] != NULL; i++) {
+        if (slice_equals(request, request->method, valid_methods[i])) {
+            return 0;
         }
     }
+    LOG_WARN("Invalid HTTP method: %.*s", (int)request->method.length, 
+             HTTP_SLICE_PTR(request, request->method));
+    return -1;  // Malformed request
 }
 
-static cache_entry_t *find_cached_response(const char *path, const http_request_t *request) {
-    char vary_key[256];
-    generate_vary_key(path, request, vary_key, sizeof(vary_key));
+static void add_header(http_request_t *request, size_t line_start, size_t colon, size_t line_end) {
+    // headers past MAX_HEADERS are validated but not recorded
+    if (request->header_count == MAX_HEADERS) {
+        return;
+    }
     
-    LOG_DEBUG("Cache lookup: path='%s', vary_key='%s'", path, vary_key);
+    const char *value = request->buffer + colon + 1;
+    const char *value_end = request->buffer + line_end;
+    while (value < value_end && (*value == ' ' || *value == '\t')) value++;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) value_end--;
     
-    unsigned int hash_idx = hash_key(vary_key);
-    if (response_cache[hash_idx].path[0] != '\0' && 
-        strcmp(response_cache[hash_idx].path, path) == 0 &&
-        strcmp(response_cache[hash_idx].vary_key, vary_key) == 0 &&
-        time(NULL) - response_cache[hash_idx].timestamp < CACHE_TIMEOUT) {
-        LOG_DEBUG("Cache hit (hash) for %s with vary key %s", path, vary_key);
-        return &response_cache[hash_idx];
-    }
+    size_t name_len = colon - line_start;
+    http_header_t *header = &request->headers[request->header_count];
+    header->name.offset = line_start;
+    header->name.length = name_len;
+    header->value.offset = value - request->buffer;
+    header->value.length = value_end - value;
     
-    for (int i = 0; i < CACHE_SIZE; i++) {
-        if (i == (int)hash_idx) continue;
-        
-        if (response_cache[i].path[0] != '\0') {
-            LOG_DEBUG("Cache entry %d: path='%s', vary_key='%s', age=%ld", 
-                      i, response_cache[i].path, response_cache[i].vary_key, 
-                      time(NULL) - response_cache[i].timestamp);
-        }
-        if (response_cache[i].path[0] != '\0' && 
-            strcmp(response_cache[i].path, path) == 0 &&
-            strcmp(response_cache[i].vary_key, vary_key) == 0 &&
-            time(NULL) - response_cache[i].timestamp < CACHE_TIMEOUT) {
-            LOG_DEBUG("Cache hit (linear) for %s with vary key %s", path, vary_key);
-            return &response_cache[i];
+    for (int i = 0; i < HTTP_HEADER_KNOWN_COUNT; i++) {
+        if (request->known[i] == -1 && name_len == known_headers[i].length &&
+            strncasecmp(request->buffer + line_start, known_headers[i].name, name_len) == 0) {
+            request->known[i] = request->header_count;
+            break;
         }
     }
-    LOG_DEBUG("Cache miss for %s with vary key %s", path, vary_key);
-    return NULL;
+    
+    request->header_count++;
 }
 
-static void cache_response(const char *path, const char *response, size_t response_len, const http_request_t *request, const char *etag) {
-    char vary_key[256];
-    generate_vary_key(path, request, vary_key, sizeof(vary_key));
-    
-    unsigned int hash_idx = hash_key(vary_key);
-    cache_entry_t *entry = &response_cache[hash_idx];
-    
-    if (entry->path[0] != '\0' && 
-        (strcmp(entry->path, path) != 0 || strcmp(entry->vary_key, vary_key) != 0)) {
-        entry = &response_cache[cache_index];
-        cache_index = (cache_index + 1) % CACHE_SIZE;
-    }
-    
-    if (entry->response) {
-        free(entry->response);
-        entry->response = NULL;
+static void finish_request(http_request_t *request) {
+    request->keep_alive = slice_equals(request, request->version, "HTTP/1.1");
+    
+    int connection = request->known[HTTP_HEADER_CONNECTION];
+    if (connection != -1) {
+        http_slice_t value = request->headers[connection].value;
+        if (slice_equals_nocase(request, value, "close")) {
+            request->keep_alive = 0;
+            LOG_DEBUG("Connection: close header found, disabling keep-alive");
+        } else if (slice_equals_nocase(request, value, "keep-alive")) {
+            request->keep_alive = 1;
+            LOG_DEBUG("Connection: keep-alive header found, enabling keep-alive");
+        }
     }
     
-    strncpy(entry->path, path, PATH_MAX - 1);
-    entry->path[PATH_MAX - 1] = '\0';
-    
-    strncpy(entry->vary_key, vary_key, sizeof(entry->vary_key) - 1);
-    entry->vary_key[sizeof(entry->vary_key) - 1] = '\0';
-    strncpy(entry->etag, etag, sizeof(entry->etag) - 1);
-    entry->etag[sizeof(entry->etag) - 1] = '\0';
-    
-    LOG_DEBUG("Cache population: path='%s', vary_key='%s', etag='%s'", path, entry->vary_key, etag);
-    
-    entry->response = malloc(response_len);
-    if (entry->response) {
-        memcpy(entry->response, response, response_len);
-        entry->response_len = response_len;
-        entry->timestamp = time(NULL);
-        LOG_DEBUG("Cached response for %s with vary key %s", path, entry->vary_key);
-    } else {
-        LOG_ERROR("Failed to allocate memory for cached response");
-    }
+    LOG_DEBUG("Request parsed: %.*s %.*s %.*s, keep-alive=%d", 
+              (int)request->method.length, HTTP_SLICE_PTR(request, request->method),
+              (int)request->uri.length, HTTP_SLICE_PTR(request, request->uri),
+              (int)request->version.length, HTTP_SLICE_PTR(request, request->version),
+              request->keep_alive);
 }
 
-int http_parse_request(const char *buffer, size_t length, http_request_t *request) {
-    char *line_start = (char *)buffer;
-    char *line_end;
-    
-    // Security: Check request size limit
-    if (length > MAX_REQUEST_SIZE) {
-        LOG_WARN("Request too large: %zu bytes (max: %d)", length, MAX_REQUEST_SIZE);
-        return -2;  // Oversized request
-    }
-    
+void http_parser_reset(http_parser_t *parser) {
+    parser->state = HTTP_PARSE_METHOD;
+    parser->pos = 0;
+    parser->mark = 0;
+    parser->colon = 0;
+    
+    http_request_t *request = &parser->request;
+    request->buffer = NULL;
+    request->length = 0;
+    request->header_count = 0;
     request->keep_alive = 0;
-    
-    line_end = strstr(line_start, "\r\n");
-    if (!line_end) return -1;  // Malformed request
-    
-    char method[16], uri[2048], version[16];
-    if (sscanf(line_start, "%15s %2047s %15s", method, uri, version) != 3) {
-        return -1;  // Malformed request
-    }
-    
-    // Security: Validate HTTP version
-    if (strcmp(version, "HTTP/1.0") != 0 && strcmp(version, "HTTP/1.1") != 0) {
-        LOG_WARN("Unsupported HTTP version: %s", version);
-        return -3;  // Unsupported version
+    for (int i = 0; i < HTTP_HEADER_KNOWN_COUNT; i++) {
+        request->known[i] = -1;
     }
+}
+
+int http_parse_request(http_parser_t *parser, const char *buffer, size_t length) {
+    http_request_t *request = &parser->request;
+    request->buffer = buffer;
     
-    // Security: Validate method
-    if (strcmp(method, "GET") != 0 && strcmp(method, "HEAD") != 0 && 
-        strcmp(method, "POST") != 0 && strcmp(method, "PUT") != 0 && 
-        strcmp(method, "DELETE") != 0 && strcmp(method, "OPTIONS") != 0 && 
-        strcmp(method, "TRACE") != 0 && strcmp(method, "PATCH") != 0) {
-        LOG_WARN("Invalid HTTP method: %s", method);
-        return -1;  // Malformed request
-    }
-    
-    strncpy(request->method, method, sizeof(request->method) - 1);
-    request->method[sizeof(request->method) - 1] = '\0';
-    strncpy(request->uri, uri, sizeof(request->uri) - 1);
-    request->uri[sizeof(request->uri) - 1] = '\0';
-    strncpy(request->version, version, sizeof(request->version) - 1);
-    request->version[sizeof(request->version) - 1] = '\0';
-    
-    line_start = line_end + 2;
-    request->header_count = 0;
+    // Security: nothing past the request size limit is scanned
+    size_t end = length < MAX_REQUEST_SIZE ? length : MAX_REQUEST_SIZE;
     
-    while (line_start < (char *)buffer + length && request->header_count < MAX_HEADERS) {
-        line_end = strstr(line_start, "\r\n");
-        if (!line_end) break;
+    while (parser->pos < end) {
+        size_t pos = parser->pos;
+        size_t stop;
         
-        if (line_end == line_start) break;
-        
-        // Security: Check header line size
-        if (line_end - line_start > MAX_HEADER_LINE_SIZE) {
-            LOG_WARN("Header line too long: %ld bytes (max: %d)", line_end - line_start, MAX_HEADER_LINE_SIZE);
-            return -1;  // Malformed request
-        }
-        
-        char *colon = strchr(line_start, ':');
-        if (colon) {
-            size_t name_len = colon - line_start;
-            char *value = colon + 1;
-            while (*value == ' ') value++;
+        switch (parser->state) {
+        case HTTP_PARSE_METHOD:
+        case HTTP_PARSE_URI:
+            stop = pos + scan_find(buffer + pos, end - pos, SCAN_REQUEST_TOKEN);
+            if (stop == end) {
+                parser->pos = end;
+                break;
+            }
+            if (stop == parser->mark || buffer[stop] != ' ') {
+                return -1;  // Malformed request
+            }
             
-            // Security: Check header name length
-            if (name_len >= MAX_HEADER_SIZE) {
-                LOG_WARN("Header name too long: %zu bytes (max: %d)", name_len, MAX_HEADER_SIZE - 1);
+            http_slice_t *token = parser->state == HTTP_PARSE_METHOD ? &request->method : &request->uri;
+            token->offset = parser->mark;
+            token->length = stop - parser->mark;
+            parser->pos = parser->mark = stop + 1;
+            parser->state = parser->state == HTTP_PARSE_METHOD ? HTTP_PARSE_URI : HTTP_PARSE_VERSION;
+            break;
+            
+        case HTTP_PARSE_VERSION:
+            stop = pos + scan_find(buffer + pos, end - pos, SCAN_REQUEST_TOKEN);
+            if (stop == end) {
+                parser->pos = end;
+                break;
+            }
+            if (stop == parser->mark || buffer[stop] != '\r') {
+                return -1;  // Malformed request
+            }
+            if (stop + 1 == end) {
+                parser->pos = stop;
+                return parse_incomplete(length);
+            }
+            if (buffer[stop + 1] != '\n') {
                 return -1;  // Malformed request
             }
             
-            // Copy header name without modifying original buffer
-            char header_name[MAX_HEADER_SIZE];
-            strncpy(header_name, line_start, name_len);
-            header_name[name_len] = '\0';
+            request->version.offset = parser->mark;
+            request->version.length = stop - parser->mark;
+            
+            int result = validate_request_line(request);
+            if (result != 0) {
+                return result;
+            }
+            parser->pos = parser->mark = stop + 2;
+            parser->state = HTTP_PARSE_HEADER_NAME;
+            break;
+            
+        case HTTP_PARSE_HEADER_NAME:
+            // Security: the first byte outside the token set must be the colon
+            stop = pos + scan_find(buffer + pos, end - pos, SCAN_HEADER_NAME);
+            
+            // Security: Check header name length
+            if (stop - parser->mark >= MAX_HEADER_SIZE) {
+                LOG_WARN("Header name too long: %zu bytes (max: %d)", stop - parser->mark, MAX_HEADER_SIZE - 1);
+                return -1;  // Malformed request
+            }
+            if (stop == end) {
+                parser->pos = end;
+                break;
+            }
             
-            // Security: Validate header name (no control characters)
-            for (char *p = header_name; *p; p++) {
-                if (*p < 32 || *p > 126) {
-                    LOG_WARN("Invalid character in header name");
+            if (stop == parser->mark && buffer[stop] == '\r') {
+                if (stop + 1 == end) {
+                    parser->pos = stop;
+                    return parse_incomplete(length);
+                }
+                if (buffer[stop + 1] != '\n') {
                     return -1;  // Malformed request
                 }
+                request->length = stop + 2;
+                finish_request(request);
+                return 0;
             }
             
-            strncpy(request->headers[request->header_count][0], header_name, MAX_HEADER_SIZE - 1);
-            request->headers[request->header_count][0][MAX_HEADER_SIZE - 1] = '\0';
-            strncpy(request->headers[request->header_count][1], value, MAX_HEADER_SIZE - 1);
-            request->headers[request->header_count][1][MAX_HEADER_SIZE - 1] = '\0';
-            
-            if (strcasecmp(header_name, "Connection") == 0) {
-                LOG_DEBUG("Found Connection header: %s", value);
+            if (stop == parser->mark || buffer[stop] != ':') {
+                LOG_WARN("Invalid character in header name");
+                return -1;  // Malformed request
             }
+            parser->colon = stop;
+            parser->pos = stop + 1;
+            parser->state = HTTP_PARSE_HEADER_VALUE;
+            break;
             
-            request->header_count++;
-        }
-        
-        line_start = line_end + 2;
-    }
-    
-    request->keep_alive = (strcmp(request->version, "HTTP/1.1") == 0);
-    
-    for (int i = 0; i < request->header_count; i++) {
-        if (strcasecmp(request->headers[i][0], "Connection") == 0) {
-            if (strcasecmp(request->headers[i][1], "close") == 0) {
-                request->keep_alive = 0;
-                LOG_DEBUG("Connection: close header found, disabling keep-alive");
-            } else if (strcasecmp(request->headers[i][1], "keep-alive") == 0) {
-                request->keep_alive = 1;
-                LOG_DEBUG("Connection: keep-alive header found, enabling keep-alive");
+        case HTTP_PARSE_HEADER_VALUE:
+            stop = pos + scan_find(buffer + pos, end - pos, SCAN_HEADER_VALUE);
+            
+            // Security: Check header line size
+            if (stop - parser->mark > MAX_HEADER_LINE_SIZE) {
+                LOG_WARN("Header line too long: %zu bytes (max: %d)", stop - parser->mark, MAX_HEADER_LINE_SIZE);
+                return -1;  // Malformed request
+            }
+            if (stop == end) {
+                parser->pos = end;
+                break;
+            }
+            if (buffer[stop] != '\r') {
+                LOG_WARN("Invalid character in header value");
+                return -1;  // Malformed request
+            }
+            if (stop + 1 == end) {
+                parser->pos = stop;
+                return parse_incomplete(length);
             }
+            if (buffer[stop + 1] != '\n') {
+                return -1;  // Malformed request
+            }
+            
+            add_header(request, parser->mark, parser->colon, stop);
+            parser->pos = parser->mark = stop + 2;
+            parser->state = HTTP_PARSE_HEADER_NAME;
             break;
         }
     }
     
-    LOG_DEBUG("Request parsed: %s %s %s, keep-alive=%d", 
-              request->method, request->uri, request->version, request->keep_alive);
-    
-    return 0;
+    return parse_incomplete(length);
+}
+
+const char *http_request_header(const http_request_t *request, http_known_header_t header, size_t *length) {
+    int index = request->known[header];
+    if (index == -1) {
+        return NULL;
+    }
+    *length = request->headers[index].value.length;
+    return HTTP_SLICE_PTR(request, request->headers[index].value);
 }
 
 void http_create_response(http_response_t *response, int status_code) {
@@ -333,6 +350,82 @@ const char *http_get_mime_type(const char *path) {
     return mime_types[0].type;
 }
 
+static int http_accepts_encoding(const http_request_t *request, const char *encoding) {
+    size_t encoding_len = strlen(encoding);
+    size_t value_len;
+    const char *p = http_request_header(request, HTTP_HEADER_ACCEPT_ENCODING, &value_len);
+    if (!p) {
+        return 0;
+    }
+    
+    const char *end = p + value_len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        const char *token = p;
+        while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t') p++;
+        size_t token_len = p - token;
+        
+        const char *next = memchr(p, ',', end - p);
+        if (!next) next = end;
+        
+        int rejected = 0;
+        const char *q = memmem(p, next - p, "q=", 2);
+        if (q) {
+            rejected = (strtod(q + 2, NULL) <= 0.0);
+        }
+        p = next;
+        
+        if (token_len == encoding_len && strncasecmp(token, encoding, encoding_len) == 0) {
+            return !rejected;
+        }
+    }
+    
+    return 0;
+}
+
+static const struct {
+    const char *encoding;
+    const char *suffix;
+    compression_type_t type;
+} precompressed_variants[] = {
+    {"br", ".br", COMPRESSION_BROTLI},
+    {"gzip", ".gz", COMPRESSION_GZIP},
+    {NULL, NULL, COMPRESSION_NONE}
+};
+
+// Looks for a pre-built sidecar (file.br, file.gz) the client accepts that is at least as new as the original
+static int open_precompressed_file(const char *full_path, const struct stat *original, 
+                                   const http_request_t *request, struct stat *st, 
+                                   compression_type_t *type) {
+    for (int i = 0; precompressed_variants[i].encoding != NULL; i++) {
+        if (!http_accepts_encoding(request, precompressed_variants[i].encoding)) {
+            continue;
+        }
+        
+        char sidecar_path[PATH_MAX];
+        int written = snprintf(sidecar_path, sizeof(sidecar_path), "%s%s", 
+                               full_path, precompressed_variants[i].suffix);
+        if (written < 0 || (size_t)written >= sizeof(sidecar_path)) {
+            continue;
+        }
+        
+        int fd = resolve_open(sidecar_path, O_RDONLY | O_NONBLOCK | O_NOFOLLOW | O_CLOEXEC, NULL);
+        if (fd == -1) {
+            continue;
+        }
+        
+        if (fstat(fd, st) == 0 && S_ISREG(st->st_mode) && st->st_mtime >= original->st_mtime) {
+            LOG_DEBUG("Serving precompressed sidecar %s", sidecar_path);
+            *type = precompressed_variants[i].type;
+            return fd;
+        }
+        
+        close(fd);
+    }
+    
+    return -1;
+}
+
 int http_serve_file(const char *path, http_response_t *response, const http_request_t *request) {
     char full_path[PATH_MAX];
     
@@ -346,31 +439,45 @@ int http_serve_file(const char *path, http_response_t *response, const http_requ
     
     LOG_DEBUG("Serving file: %s", full_path);
     
-    int file_fd = open(full_path, O_RDONLY | O_NONBLOCK);
-    if (file_fd == -1) {
+    file_info_t *info = filecache_open(full_path);
+    if (!info) {
         LOG_WARN("Failed to open file %s: %s", full_path, strerror(errno));
         return -1;
     }
     
-    struct stat st;
-    if (fstat(file_fd, &st) == -1) {
-        LOG_ERROR("Failed to stat file %s: %s", full_path, strerror(errno));
-        close(file_fd);
-        return -1;
-    }
-    
-    if (!S_ISREG(st.st_mode)) {
+    if (!S_ISREG(info->st.st_mode)) {
         LOG_WARN("Not a regular file: %s", full_path);
-        close(file_fd);
+        filecache_release(info);
         return -1;
     }
     
+    const struct stat st = info->st;
+    int file_fd = info->fd;
+    
     const char *mime_type = http_get_mime_type(full_path);
     http_add_header(response, "Content-Type", mime_type);
     
     int is_compressible = http_should_compress_mime_type(mime_type);
     
-    if (is_compressible && response->compression_type != COMPRESSION_NONE && st.st_size <= 10 * 1024 * 1024) {
+    struct stat sidecar_st;
+    compression_type_t sidecar_type = COMPRESSION_NONE;
+    int sidecar_fd = -1;
+    if (config_get_instance()->static_precompression && request) {
+        sidecar_fd = open_precompressed_file(full_path, &st, request, &sidecar_st, &sidecar_type);
+    }
+    
+    if (sidecar_fd != -1) {
+        response->body_length = sidecar_st.st_size;
+        response->file_fd = sidecar_fd;
+        response->is_file = 1;
+        response->compression_type = sidecar_type;
+        
+        http_add_header(response, "Content-Encoding", sidecar_type == COMPRESSION_BROTLI ? "br" : "gzip");
+        
+        char content_length[32];
+        snprintf(content_length, sizeof(content_length), "%ld", (long)sidecar_st.st_size);
+        http_add_header(response, "Content-Length", content_length);
+    } else if (is_compressible && response->compression_type != COMPRESSION_NONE && st.st_size <= 10 * 1024 * 1024) {
         void *file_content = malloc(st.st_size);
         if (file_content) {
             ssize_t bytes_read = pread(file_fd, file_content, st.st_size, 0);
@@ -378,7 +485,6 @@ int http_serve_file(const char *path, http_response_t *response, const http_requ
                 response->body = file_content;
                 response->body_length = st.st_size;
                 response->is_file = 0;
-                close(file_fd);
                 
                 int compression_level = COMPRESSION_LEVEL_DEFAULT;
                 
@@ -444,30 +550,9 @@ int http_serve_file(const char *path, http_response_t *response, const http_requ
         http_add_header(response, "Content-Length", content_length);
     }
     
-    char last_modified[64];
-    struct tm *tm_info = gmtime(&st.st_mtime);
-    strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT", tm_info);
-    http_add_header(response, "Last-Modified", last_modified);
-    
-    // Security: Generate more secure ETag using better hash
-    char etag[64];
-    char etag_input[PATH_MAX + 128]; // Ensure enough space for path + numbers
-    int written = snprintf(etag_input, sizeof(etag_input), "%s:%lu:%lu:%lu", 
-                          full_path, (unsigned long)st.st_ino, 
-                          (unsigned long)st.st_size, (unsigned long)st.st_mtime);
-    
-    // Truncate if too long (shouldn't happen with our buffer size)
-    if (written >= (int)sizeof(etag_input)) {
-        etag_input[sizeof(etag_input) - 1] = '\0';
-    }
-    
-    // Simple but better hash than just concatenation
-    unsigned long hash = 5381;
-    for (char *p = etag_input; *p; p++) {
-        hash = ((hash << 5) + hash) + *p;
-    }
+    http_add_header(response, "Last-Modified", info->last_modified);
     
-    snprintf(etag, sizeof(etag), "\"%lx\"", hash);
+    const char *etag = info->etag;
     http_add_header(response, "ETag", etag);
     
     http_add_header(response, "Vary", "Accept-Encoding, User-Agent");
@@ -496,248 +581,444 @@ int http_serve_file(const char *path, http_response_t *response, const http_requ
             http_add_header(response, "Cache-Control", "public, max-age=3600");
         }
         
-        if (st.st_size < 1024 * 1024 && response->compressed_body == NULL) {
-            char *file_content = malloc(st.st_size);
-            if (file_content) {
-                ssize_t bytes_read = pread(file_fd, file_content, st.st_size, 0);
-                if (bytes_read == st.st_size) {
-                    char header[4096];
-                    int header_len = 0;
-                    
-                    header_len += snprintf(header + header_len, sizeof(header) - header_len,
-                                          "HTTP/1.1 200 OK\r\n");
-                    
-                    for (int i = 0; i < response->header_count; i++) {
-                        header_len += snprintf(header + header_len, sizeof(header) - header_len,
-                                             "%s: %s\r\n", 
-                                             response->headers[i][0], 
-                                             response->headers[i][1]);
-                    }
-                    
+        // the watcher only sees canonical directories, so a file behind a symlink could never be invalidated
+        if (st.st_size < MAX_CACHEABLE_FILE_SIZE && sidecar_fd == -1 && !info->symlinked) {
+            // cache exactly the bytes this response will carry, so each encoding is only compressed once
+            const char *body = NULL;
+            size_t body_len = 0;
+            char *file_content = NULL;
+            
+            if (response->compressed_body) {
+                body = response->compressed_body;
+                body_len = response->compressed_length;
+            } else if (response->body) {
+                body = response->body;
+                body_len = response->body_length;
+            } else {
+                file_content = malloc(st.st_size);
+                if (file_content && pread(file_fd, file_content, st.st_size, 0) == st.st_size) {
+                    body = file_content;
+                    body_len = st.st_size;
+                }
+            }
+            
+            if (body) {
+                char header[4096];
+                int header_len = 0;
+                
+                header_len += snprintf(header + header_len, sizeof(header) - header_len,
+                                      "HTTP/1.1 200 OK\r\n");
+                
+                for (int i = 0; i < response->header_count; i++) {
                     header_len += snprintf(header + header_len, sizeof(header) - header_len,
-                                          "Connection: keep-alive\r\n");
-                    
-                    header_len += snprintf(header + header_len, sizeof(header) - header_len, "\r\n");
-                    
-                    char *complete_response = malloc(header_len + st.st_size);
-                    if (complete_response) {
-                        memcpy(complete_response, header, header_len);
-                        memcpy(complete_response + header_len, file_content, st.st_size);
-                        cache_response(full_path, complete_response, header_len + st.st_size, request, etag);
-                        free(complete_response);
-                    }
+                                         "%s: %s\r\n", 
+                                         response->headers[i][0], 
+                                         response->headers[i][1]);
+                }
+                
+                header_len += snprintf(header + header_len, sizeof(header) - header_len,
+                                      "Connection: keep-alive\r\n");
+                
+                header_len += snprintf(header + header_len, sizeof(header) - header_len, "\r\n");
+                
+                char *complete_response = NULL;
+                if (header_len < (int)sizeof(header)) {
+                    complete_response = malloc(header_len + body_len);
+                }
+                if (complete_response) {
+                    memcpy(complete_response, header, header_len);
+                    memcpy(complete_response + header_len, body, body_len);
+                    cache_store(full_path, response->compression_type, complete_response,
+                                header_len + body_len, header_len, etag);
+                    free(complete_response);
                 }
-                free(file_content);
             }
+            free(file_content);
         }
     } else {
         http_add_header(response, "Cache-Control", "no-cache, no-store, must-revalidate");
     }
     
+    // a response streaming the file keeps its reference until http_free_response()
+    if (response->is_file && response->file_fd == file_fd) {
+        response->file_info = info;
+    } else {
+        filecache_release(info);
+    }
+    
     return 0;
 }
 
+// builds the same response a GET for path would produce, purely for the side effect of caching it
+int http_preload_file(const char *path, compression_type_t type) {
+    http_response_t response;
+    http_create_response(&response, 200);
+    response.compression_type = type;
+    
+    int result = http_serve_file(path, &response, NULL);
+    http_free_response(&response);
+    return result;
+}
+
+// the Connection header and version were already folded into keep_alive by the parser
 int http_should_keep_alive(const http_request_t *request) {
-    if (strcmp(request->version, "HTTP/1.1") == 0) {
-        for (int i = 0; i < request->header_count; i++) {
-            if (strcasecmp(request->headers[i][0], "Connection") == 0) {
-                if (strcasecmp(request->headers[i][1], "close") == 0) {
-                    LOG_DEBUG("HTTP/1.1 request with Connection: close, disabling keep-alive");
-                    return 0;
-                }
-                break;
-            }
-        }
-        LOG_DEBUG("HTTP/1.1 request without Connection: close, enabling keep-alive");
-        return 1;
-    }
-    
-    if (strcmp(request->version, "HTTP/1.0") == 0) {
-        for (int i = 0; i < request->header_count; i++) {
-            if (strcasecmp(request->headers[i][0], "Connection") == 0) {
-                if (strcasecmp(request->headers[i][1], "keep-alive") == 0) {
-                    LOG_DEBUG("HTTP/1.0 request with Connection: keep-alive, enabling keep-alive");
-                    return 1;
-                }
-                break;
-            }
-        }
-        LOG_DEBUG("HTTP/1.0 request without Connection: keep-alive, disabling keep-alive");
-        return 0;
-    }
-    
-    LOG_DEBUG("Unknown HTTP version, disabling keep-alive");
-    return 0;
+    LOG_DEBUG("%.*s request, keep-alive=%d", (int)request->version.length, 
+              HTTP_SLICE_PTR(request, request->version), request->keep_alive);
+    return request->keep_alive;
 }
 
-int http_send_response(int client_fd, http_response_t *response) {
-    if (response->is_cached && response->cached_response) {
-        ssize_t total_sent = 0;
-        size_t remaining = response->body_length;
-        const char *ptr = response->cached_response;
-        
-        while (remaining > 0) {
-            ssize_t sent = send(client_fd, ptr + total_sent, remaining, MSG_NOSIGNAL);
-            if (sent <= 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    return 0;  
-                } else if (errno == EPIPE || errno == ECONNRESET) {
-                    LOG_DEBUG("Client disconnected during send: %s", strerror(errno));
-                    return -1;
-                }
-                LOG_ERROR("Failed to send cached response: %s", strerror(errno));
+// writes the iovecs with as few sendmsg() calls as the socket allows, adding the bytes written to *written
+static int send_iov(int client_fd, struct iovec *iov, int iovcnt, int flags, const char *what, size_t *written) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+    
+    while (msg.msg_iovlen > 0) {
+        ssize_t sent = sendmsg(client_fd, &msg, flags | MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            } else if (errno == EPIPE || errno == ECONNRESET) {
+                LOG_DEBUG("Client disconnected during %s send: %s", what, strerror(errno));
                 return -1;
             }
-            
-            total_sent += sent;
-            remaining -= sent;
+            LOG_ERROR("Failed to send %s: %s", what, strerror(errno));
+            return -1;
         }
         
-        return 1;  
+        *written += sent;
+        while (msg.msg_iovlen > 0 && (size_t)sent >= msg.msg_iov->iov_len) {
+            sent -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen > 0) {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + sent;
+            msg.msg_iov->iov_len -= sent;
+        }
     }
     
-    int header_len = 0;
+    return 1;
+}
+
+static void append_header_text(char *out, size_t size, size_t *len, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(*len < size ? out + *len : NULL, *len < size ? size - *len : 0, format, args);
+    va_end(args);
+    if (written > 0) {
+        *len += written;
+    }
+}
+
+// returns the full length even when it does not fit, like snprintf()
+static size_t format_headers(const http_response_t *response, char *out, size_t size) {
+    size_t len = 0;
     
-    header_len += snprintf(header_buffer + header_len, sizeof(header_buffer) - header_len,
-                          "HTTP/1.1 %d %s\r\n", 
-                          response->status_code, 
-                          response->status_text ? response->status_text : "Unknown");
+    append_header_text(out, size, &len, "HTTP/1.1 %d %s\r\n", 
+                       response->status_code, 
+                       response->status_text ? response->status_text : "Unknown");
     
     for (int i = 0; i < response->header_count; i++) {
-        header_len += snprintf(header_buffer + header_len, sizeof(header_buffer) - header_len,
-                              "%s: %s\r\n", 
-                              response->headers[i][0], 
-                              response->headers[i][1]);
+        append_header_text(out, size, &len, "%s: %s\r\n", 
+                           response->headers[i][0], 
+                           response->headers[i][1]);
     }
     
-    if (response->keep_alive) {
-        header_len += snprintf(header_buffer + header_len, sizeof(header_buffer) - header_len,
-                              "Connection: keep-alive\r\n");
-    } else {
-        header_len += snprintf(header_buffer + header_len, sizeof(header_buffer) - header_len,
-                              "Connection: close\r\n");
+    append_header_text(out, size, &len, response->keep_alive ? "Connection: keep-alive\r\n\r\n" 
+                                                             : "Connection: close\r\n\r\n");
+    
+    return len;
+}
+
+static http_output_t *output_at(http_output_queue_t *queue, int index) {
+    return &queue->entries[(queue->head + index) % HTTP_OUTPUT_QUEUE_SIZE];
+}
+
+static void output_pop(http_output_queue_t *queue) {
+    http_output_t *out = output_at(queue, 0);
+    
+    if (out->file_info) {
+        filecache_release(out->file_info);
+    } else if (out->file_fd != -1) {
+        close(out->file_fd);
+    }
+    if (out->cached_object) {
+        cache_release(out->cached_object);
+    }
+    free(out->owned_body);
+    if (out->header_owned) {
+        free(out->header_data);
     }
     
-    header_len += snprintf(header_buffer + header_len, sizeof(header_buffer) - header_len, "\r\n");
+    queue->head = (queue->head + 1) % HTTP_OUTPUT_QUEUE_SIZE;
+    queue->count--;
+}
+
+int http_output_push(http_output_queue_t *queue, http_response_t *response) {
+    if (queue->count == HTTP_OUTPUT_QUEUE_SIZE) {
+        return -1;
+    }
     
-    if (response->is_file && response->file_fd >= 0) {
-        ssize_t sent = send(client_fd, header_buffer, header_len, MSG_MORE | MSG_NOSIGNAL);
-        if (sent != header_len) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                return 0;
-            } else if (errno == EPIPE || errno == ECONNRESET) {
-                LOG_DEBUG("Client disconnected during header send: %s", strerror(errno));
-                return -1;
-            }
-            LOG_ERROR("Failed to send headers: %s", strerror(errno));
+    http_output_t *out = output_at(queue, queue->count);
+    memset(out, 0, sizeof(*out));
+    out->file_fd = -1;
+    
+    if (response->is_cached && response->cached_object) {
+        // cached objects already start with their serialized headers
+        out->cached_object = response->cached_object;
+        out->body = response->cached_object->data;
+        out->body_length = response->body_length;
+        response->cached_object = NULL;
+        queue->count++;
+        return 0;
+    }
+    
+    size_t room = sizeof(header_buffer) - header_buffer_used;
+    size_t length = format_headers(response, header_buffer + header_buffer_used, room);
+    if (length < room) {
+        out->header_data = header_buffer + header_buffer_used;
+        header_buffer_used += length;
+    } else {
+        out->header_data = malloc(length + 1);
+        if (!out->header_data) {
+            LOG_ERROR("Failed to allocate response headers");
             return -1;
         }
+        format_headers(response, out->header_data, length + 1);
+        out->header_owned = 1;
+    }
+    out->header_length = length;
+    
+    // the entry takes over whatever holds the body, so freeing the response leaves it alone
+    if (response->is_file && response->file_fd >= 0) {
+        out->file_fd = response->file_fd;
+        out->file_info = response->file_info;
+        out->body_length = response->body_length;
+        response->is_file = 0;
+        response->file_fd = -1;
+        response->file_info = NULL;
+    } else if (response->compressed_body && response->compressed_length > 0 && response->body_length > 0) {
+        out->owned_body = response->compressed_body;
+        out->body = response->compressed_body;
+        out->body_length = response->compressed_length;
+        response->compressed_body = NULL;
+    } else if (response->body && response->body_length > 0) {
+        out->owned_body = response->body;
+        out->body = response->body;
+        out->body_length = response->body_length;
+        response->body = NULL;
+    }
+    
+    queue->count++;
+    return 0;
+}
+
+// queues a complete response kept in static storage, which is sent as it is
+int http_output_push_static(http_output_queue_t *queue, const char *data, size_t length) {
+    if (queue->count == HTTP_OUTPUT_QUEUE_SIZE) {
+        return -1;
+    }
+    
+    http_output_t *out = output_at(queue, queue->count);
+    memset(out, 0, sizeof(*out));
+    out->file_fd = -1;
+    out->body = data;
+    out->body_length = length;
+    
+    queue->count++;
+    return 0;
+}
+
+// accounts the bytes of one sendmsg() to the entries in order and drops the finished ones
+void http_output_complete(http_output_queue_t *queue, size_t written) {
+    while (queue->count > 0) {
+        http_output_t *out = output_at(queue, 0);
         
-        off_t offset = response->file_offset; 
-        size_t __attribute__((unused)) total_sent = 0;
-        size_t remaining = response->body_length - offset;
-        
-        const size_t CHUNK_SIZE = 1024 * 1024;
+        size_t part = out->header_length - out->header_sent;
+        if (part > written) {
+            part = written;
+        }
+        out->header_sent += part;
+        written -= part;
         
-        while (remaining > 0) {
-            size_t to_send = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
-            ssize_t sent = sendfile(client_fd, response->file_fd, &offset, to_send);
-            
-            if (sent <= 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    response->file_offset = offset;
-                    return 0;  
-                } else if (errno == EPIPE || errno == ECONNRESET) {
-                    LOG_DEBUG("Client disconnected during file send: %s", strerror(errno));
-                    return -1;
-                }
-                LOG_ERROR("Failed to send file: %s", strerror(errno));
-                return -1;
+        if (out->file_fd == -1) {
+            part = out->body_length - out->body_sent;
+            if (part > written) {
+                part = written;
             }
-            
-            total_sent += sent;
-            remaining -= sent;
+            out->body_sent += part;
+            written -= part;
         }
         
-        int off = 0;
-        setsockopt(client_fd, IPPROTO_TCP, TCP_CORK, &off, sizeof(off));
-        
-        return 1;  
+        // a file entry, even an empty one, is popped by http_output_send_file() once it has finished
+        if (out->header_sent < out->header_length || out->file_fd != -1 || out->body_sent < out->body_length) {
+            break;
+        }
+        output_pop(queue);
     }
+}
+
+static int output_sendfile(int client_fd, http_output_t *out) {
+    off_t offset = out->body_sent;
+    size_t remaining = out->body_length - out->body_sent;
     
-    if (response->compressed_body && response->compressed_length > 0) {
-        ssize_t sent = send(client_fd, header_buffer, header_len, MSG_MORE | MSG_NOSIGNAL);
-        if (sent != header_len) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+    const size_t CHUNK_SIZE = 1024 * 1024;
+    
+    while (remaining > 0) {
+        size_t to_send = (remaining > CHUNK_SIZE) ? CHUNK_SIZE : remaining;
+        ssize_t sent = sendfile(client_fd, out->file_fd, &offset, to_send);
+        
+        if (sent <= 0) {
+            out->body_sent = offset;
+            if (sent == 0) {
+                LOG_ERROR("File shrank while being sent (%zu bytes missing)", remaining);
+                return -1;
+            } else if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 return 0;  
             } else if (errno == EPIPE || errno == ECONNRESET) {
-                LOG_DEBUG("Client disconnected during header send: %s", strerror(errno));
+                LOG_DEBUG("Client disconnected during file send: %s", strerror(errno));
                 return -1;
             }
-            LOG_ERROR("Failed to send headers: %s", strerror(errno));
+            LOG_ERROR("Failed to send file: %s", strerror(errno));
             return -1;
         }
         
-        sent = send(client_fd, response->compressed_body, response->compressed_length, MSG_NOSIGNAL);
-        if (sent != (ssize_t)response->compressed_length) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                return 0;  
-            } else if (errno == EPIPE || errno == ECONNRESET) {
-                LOG_DEBUG("Client disconnected during compressed body send: %s", strerror(errno));
-                return -1;
-            }
-            LOG_ERROR("Failed to send compressed body: %s", strerror(errno));
-            return -1;
+        remaining -= sent;
+    }
+    out->body_sent = offset;
+    
+    return 1;
+}
+
+// everything up to and including the headers of the first sendfile() entry goes in one sendmsg();
+// returns the number of iovecs filled, 0 when a file body is at the head, and sets *more when one follows
+int http_output_gather(http_output_queue_t *queue, struct iovec *iov, int *more) {
+    int iovcnt = 0;
+    http_output_t *file = NULL;
+    
+    for (int i = 0; i < queue->count && !file; i++) {
+        http_output_t *out = output_at(queue, i);
+        if (out->header_sent < out->header_length) {
+            iov[iovcnt].iov_base = out->header_data + out->header_sent;
+            iov[iovcnt].iov_len = out->header_length - out->header_sent;
+            iovcnt++;
+        }
+        if (out->file_fd != -1) {
+            file = out;
+        } else if (out->body_sent < out->body_length) {
+            iov[iovcnt].iov_base = (char *)out->body + out->body_sent;
+            iov[iovcnt].iov_len = out->body_length - out->body_sent;
+            iovcnt++;
         }
+    }
+    
+    // MSG_MORE holds the headers back so they leave in the same segment as the start of the file
+    *more = file && file->body_sent < file->body_length;
+    return iovcnt;
+}
+
+// sends the body of the file entry at the head once nothing is owed before it; 1 when done, 0 on EAGAIN
+int http_output_send_file(int client_fd, http_output_queue_t *queue) {
+    http_output_t *out = output_at(queue, 0);
+    int result = out->file_fd != -1 ? output_sendfile(client_fd, out) : 1;
+    if (result == 1) {
+        output_pop(queue);
+    }
+    return result;
+}
+
+static int output_write(int client_fd, http_output_queue_t *queue) {
+    while (queue->count > 0) {
+        struct iovec iov[HTTP_OUTPUT_IOV_MAX];
+        int more;
+        int iovcnt = http_output_gather(queue, iov, &more);
         
-        return 1;  
+        int result;
+        if (iovcnt > 0) {
+            size_t written = 0;
+            result = send_iov(client_fd, iov, iovcnt, more ? MSG_MORE : 0, "response", &written);
+            http_output_complete(queue, written);
+        } else {
+            result = http_output_send_file(client_fd, queue);
+        }
+        if (result != 1) {
+            return result;
+        }
     }
     
-    if (response->body && response->body_length > 0) {
-        ssize_t sent = send(client_fd, header_buffer, header_len, MSG_MORE | MSG_NOSIGNAL);
-        if (sent != header_len) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                return 0;  
-            } else if (errno == EPIPE || errno == ECONNRESET) {
-                LOG_DEBUG("Client disconnected during header send: %s", strerror(errno));
-                return -1;
-            }
-            LOG_ERROR("Failed to send headers: %s", strerror(errno));
-            return -1;
+    return 1;
+}
+
+int http_output_flush(int client_fd, http_output_queue_t *queue) {
+    int result = output_write(client_fd, queue);
+    if (http_output_detach(queue, NULL, 0) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+// the staging area is reused by the next batch, so entries still owing headers keep their own copy,
+// packed into area while it has room and allocated beyond that
+int http_output_detach(http_output_queue_t *queue, char *area, size_t area_size) {
+    int result = 0;
+    for (int i = 0; i < queue->count; i++) {
+        http_output_t *out = output_at(queue, i);
+        if (!out->header_data || out->header_owned) {
+            continue;
         }
         
-        sent = send(client_fd, response->body, response->body_length, MSG_NOSIGNAL);
-        if (sent != (ssize_t)response->body_length) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                return 0;  
-            } else if (errno == EPIPE || errno == ECONNRESET) {
-                LOG_DEBUG("Client disconnected during body send: %s", strerror(errno));
-                return -1;
+        char *copy = NULL;
+        if (out->header_sent < out->header_length && out->header_length <= area_size) {
+            copy = area;
+            memcpy(copy, out->header_data, out->header_length);
+            area += out->header_length;
+            area_size -= out->header_length;
+        } else if (out->header_sent < out->header_length) {
+            copy = malloc(out->header_length);
+            if (!copy) {
+                LOG_ERROR("Failed to allocate pending response headers");
+                result = -1;
+            } else {
+                memcpy(copy, out->header_data, out->header_length);
+                out->header_owned = 1;
             }
-            LOG_ERROR("Failed to send body: %s", strerror(errno));
-            return -1;
         }
-        
-        return 1;  
+        out->header_data = copy;
     }
+    header_buffer_used = 0;
     
-    ssize_t sent = send(client_fd, header_buffer, header_len, MSG_NOSIGNAL);
-    if (sent != header_len) {
-        if (errno == EAGAIN || errno == EWOULDBLOCK) {
-            return 0;  
-        } else if (errno == EPIPE || errno == ECONNRESET) {
-            LOG_DEBUG("Client disconnected during header send: %s", strerror(errno));
-            return -1;
-        }
-        LOG_ERROR("Failed to send headers: %s", strerror(errno));
+    return result;
+}
+
+void http_output_clear(http_output_queue_t *queue) {
+    while (queue->count > 0) {
+        output_pop(queue);
+    }
+    queue->head = 0;
+}
+
+// writes a single response outside of any connection queue; whatever does not fit the socket is dropped
+int http_send_response(int client_fd, http_response_t *response) {
+    http_output_queue_t queue = { .head = 0, .count = 0 };
+    if (http_output_push(&queue, response) != 0) {
         return -1;
     }
-    
-    return 1;  
+    int result = http_output_flush(client_fd, &queue);
+    http_output_clear(&queue);
+    return result;
 }
 
 void http_free_response(http_response_t *response) {
-    if (response->is_file && response->file_fd != -1) {
+    if (response->file_info) {
+        filecache_release(response->file_info);
+        response->file_info = NULL;
+    } else if (response->is_file && response->file_fd != -1) {
         close(response->file_fd);
     }
     
@@ -750,113 +1031,58 @@ void http_free_response(http_response_t *response) {
         free(response->compressed_body);
         response->compressed_body = NULL;
     }
-}
-
-static int validate_and_resolve_path(const char *root_dir, const char *request_path, char *resolved_path, size_t resolved_path_size) {
-    // First, check for obvious path traversal attempts
-    if (strstr(request_path, "..") != NULL) {
-        LOG_WARN("Path traversal attempt detected: %s", request_path);
-        return -1;
-    }
     
-    // Check for null bytes (could be used to bypass checks)
-    if (strlen(request_path) != strcspn(request_path, "\0")) {
-        LOG_WARN("Null byte in path: %s", request_path);
-        return -1;
+    if (response->cached_object) {
+        cache_release(response->cached_object);
+        response->cached_object = NULL;
     }
-    
-    // Build the full path
-    char temp_path[PATH_MAX];
-    int written = snprintf(temp_path, sizeof(temp_path), "%s%s", root_dir, request_path);
-    if (written < 0 || (size_t)written >= sizeof(temp_path)) {
-        LOG_ERROR("Path too long: %s%s", root_dir, request_path);
-        return -1;
-    }
-    
-    // Resolve the canonical path
-    char canonical_path[PATH_MAX];
-    if (realpath(temp_path, canonical_path) == NULL) {
-        // If realpath fails, the file might not exist yet, but we still need to validate the directory structure
-        // Try to resolve the parent directory and validate
-        char temp_dir[PATH_MAX];
-        strncpy(temp_dir, temp_path, sizeof(temp_dir) - 1);
-        temp_dir[sizeof(temp_dir) - 1] = '\0';
+}
+
+// weak comparison of an If-None-Match list against one of our quoted ETags
+static int http_etag_matches(const char *list, size_t list_len, const char *etag) {
+    const char *ours = etag;
+    size_t ours_len = strlen(etag);
+    if (ours_len >= 2 && ours[0] == '"' && ours[ours_len - 1] == '"') {
+        ours++;
+        ours_len -= 2;
+    }
+    
+    const char *p = list;
+    const char *end = list + list_len;
+    while (p < end) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+        if (p == end) {
+            break;
+        }
+        const char *token = p;
+        const char *next = memchr(p, ',', (size_t)(end - p));
+        if (!next) next = end;
+        const char *token_end = next;
+        while (token_end > token && (token_end[-1] == ' ' || token_end[-1] == '\t')) token_end--;
+        p = next;
         
-        char *last_slash = strrchr(temp_dir, '/');
-        if (last_slash != NULL) {
-            *last_slash = '\0';
-            
-            char canonical_dir[PATH_MAX];
-            if (realpath(temp_dir, canonical_dir) == NULL) {
-                // Parent directory doesn't exist or is inaccessible
-                return -1;
-            }
-            
-            // Verify parent directory is within root
-            char canonical_root[PATH_MAX];
-            if (realpath(root_dir, canonical_root) == NULL) {
-                LOG_ERROR("Cannot resolve root directory: %s", root_dir);
-                return -1;
-            }
-            
-            size_t root_len = strlen(canonical_root);
-            if (strncmp(canonical_dir, canonical_root, root_len) != 0 ||
-                (canonical_dir[root_len] != '\0' && canonical_dir[root_len] != '/')) {
-                LOG_WARN("Path traversal attempt - parent directory outside root: %s", canonical_dir);
-                return -1;
-            }
-            
-            // Reconstruct the full path with the canonical directory
-            // Check that the combined length won't exceed buffer size
-            size_t dir_len = strlen(canonical_dir);
-            size_t file_len = strlen(last_slash + 1);
-            if (dir_len + 1 + file_len >= sizeof(canonical_path)) {
-                LOG_ERROR("Reconstructed path too long");
-                return -1;
-            }
-            // Use safer string operations to avoid format truncation warnings
-            strncpy(canonical_path, canonical_dir, sizeof(canonical_path) - 1);
-            canonical_path[sizeof(canonical_path) - 1] = '\0';
-            strncat(canonical_path, "/", sizeof(canonical_path) - strlen(canonical_path) - 1);
-            strncat(canonical_path, last_slash + 1, sizeof(canonical_path) - strlen(canonical_path) - 1);
-        } else {
-            // No directory separator found, use the temp_path as is but validate root
-            char canonical_root[PATH_MAX];
-            if (realpath(root_dir, canonical_root) == NULL) {
-                LOG_ERROR("Cannot resolve root directory: %s", root_dir);
-                return -1;
-            }
-            strncpy(canonical_path, temp_path, sizeof(canonical_path) - 1);
-            canonical_path[sizeof(canonical_path) - 1] = '\0';
+        size_t token_len = token_end - token;
+        if (token_len == 1 && token[0] == '*') {
+            return 1;
+        }
+        
+        if (token_len >= 2 && token[0] == 'W' && token[1] == '/') {
+            token += 2;
+            token_len -= 2;
+        }
+        if (token_len >= 2 && token[0] == '"' && token[token_len - 1] == '"') {
+            token++;
+            token_len -= 2;
+        }
+        
+        LOG_DEBUG("Comparing cleaned ETags: client '%.*s' vs ours '%.*s'", 
+                  (int)token_len, token, (int)ours_len, ours);
+        
+        if (token_len == ours_len && memcmp(token, ours, ours_len) == 0) {
+            return 1;
         }
     }
     
-    // Resolve the canonical root directory
-    char canonical_root[PATH_MAX];
-    if (realpath(root_dir, canonical_root) == NULL) {
-        LOG_ERROR("Cannot resolve root directory: %s", root_dir);
-        return -1;
-    }
-    
-    // Ensure the canonical path is within the root directory
-    size_t root_len = strlen(canonical_root);
-    if (strncmp(canonical_path, canonical_root, root_len) != 0 ||
-        (canonical_path[root_len] != '\0' && canonical_path[root_len] != '/')) {
-        LOG_WARN("Path traversal attempt detected: %s resolves to %s, outside of root %s", 
-                 request_path, canonical_path, canonical_root);
-        return -1;
-    }
-    
-    // Copy the validated path to the output buffer
-    if (strlen(canonical_path) >= resolved_path_size) {
-        LOG_ERROR("Resolved path too long: %s", canonical_path);
-        return -1;
-    }
-    
-    strncpy(resolved_path, canonical_path, resolved_path_size - 1);
-    resolved_path[resolved_path_size - 1] = '\0';
-    
-    LOG_DEBUG("Path validated: %s -> %s", request_path, resolved_path);
     return 0;
 }
 
@@ -864,9 +1090,9 @@ void http_handle_request(const http_request_t *request, http_response_t *respons
     http_create_response(response, 200);
 
     int is_head = 0;
-    if (strcmp(request->method, "GET") == 0) {
+    if (slice_equals(request, request->method, "GET")) {
         is_head = 0;
-    } else if (strcmp(request->method, "HEAD") == 0) {
+    } else if (slice_equals(request, request->method, "HEAD")) {
         is_head = 1;
     } else {
         response->status_code = 501;
@@ -878,94 +1104,41 @@ void http_handle_request(const http_request_t *request, http_response_t *respons
     config_t *config = config_get_instance();
 
     char file_path[PATH_MAX];
-    const char *request_path = strcmp(request->uri, "/") == 0 ? "/index.html" : request->uri;
+    const char *request_path = HTTP_SLICE_PTR(request, request->uri);
+    size_t request_path_len = request->uri.length;
+    if (slice_equals(request, request->uri, "/")) {
+        request_path = "/index.html";
+        request_path_len = strlen(request_path);
+    }
 
-    if (validate_and_resolve_path(config->root_dir, request_path, file_path, sizeof(file_path)) != 0) {
-        LOG_WARN("Invalid or unsafe path requested: %s", request_path);
+    if (resolve_path(request_path, request_path_len, file_path, sizeof(file_path)) != 0) {
+        LOG_WARN("Invalid or unsafe path requested: %.*s", (int)request_path_len, request_path);
         response->status_code = 403;
         response->status_text = "Forbidden";
         response->keep_alive = 0;
         return;
     }
     
-    cache_entry_t *cache = find_cached_response(file_path, request);
+    const char *content_type = http_get_mime_type(file_path);
+    
+    int is_compressible = http_should_compress_mime_type(content_type);
+    
+    compression_type_t compression_type = COMPRESSION_NONE;
+    if (is_compressible) {
+        compression_type = http_negotiate_compression(request);
+    }
+    
+    cache_object_t *cache = cache_lookup(file_path, compression_type);
     if (cache) {
         LOG_DEBUG("Using cached response for %s", file_path);
-        const char *if_none = NULL;
-        for (int i = 0; i < request->header_count; i++) {
-            if (strcasecmp(request->headers[i][0], "If-None-Match") == 0) {
-                if_none = request->headers[i][1];
-                break;
-            }
-        }
+        size_t if_none_len;
+        const char *if_none = http_request_header(request, HTTP_HEADER_IF_NONE_MATCH, &if_none_len);
 
         if (if_none) {
-            LOG_DEBUG("Checking cached ETag: client sent '%s', cached has '%s'", if_none, cache->etag);
-            
-            char if_none_copy[1024];
-            strncpy(if_none_copy, if_none, sizeof(if_none_copy) - 1);
-            if_none_copy[sizeof(if_none_copy) - 1] = '\0';
-            
-            char *token = strtok(if_none_copy, ",");
-            int matched = 0;
+            LOG_DEBUG("Checking cached ETag: client sent '%.*s', cached has '%s'", 
+                      (int)if_none_len, if_none, cache->etag);
             
-            while (token && !matched) {
-                while (isspace(*token)) token++;
-                
-                if (strcmp(token, "*") == 0) {
-                    matched = 1;
-                    break;
-                }
-                
-                char clean_token[256] = {0};
-                const char *start = token;
-                if (*start == 'W' && *(start+1) == '/') {
-                    start += 2;
-                }
-                
-                if (*start == '"') {
-                    start++;
-                    const char *end = strrchr(start, '"');
-                    if (end) {
-                        size_t len = end - start;
-                        strncpy(clean_token, start, len);
-                        clean_token[len] = '\0';
-                    } else {
-                        strncpy(clean_token, start, sizeof(clean_token) - 1);
-                    }
-                } else {
-                    strncpy(clean_token, start, sizeof(clean_token) - 1);
-                }
-                
-                char *p = clean_token + strlen(clean_token) - 1;
-                while (p >= clean_token && isspace(*p)) {
-                    *p = '\0';
-                    p--;
-                }
-                
-                char cached_etag[64] = {0};
-                const char *etag_start = cache->etag;
-                if (*etag_start == '"') {
-                    etag_start++;
-                    const char *etag_end = strrchr(etag_start, '"');
-                    if (etag_end) {
-                        size_t len = etag_end - etag_start;
-                        strncpy(cached_etag, etag_start, len);
-                        cached_etag[len] = '\0';
-                    }
-                } else {
-                    strncpy(cached_etag, etag_start, sizeof(cached_etag) - 1);
-                }
-                
-                LOG_DEBUG("Comparing cleaned ETags: client '%s' vs cached '%s'", clean_token, cached_etag);
-                
-                if (strcmp(clean_token, cached_etag) == 0) {
-                    matched = 1;
-                    break;
-                }
-                
-                token = strtok(NULL, ",");
-            }
+            int matched = http_etag_matches(if_none, if_none_len, cache->etag);
             
             if (matched) {
                 LOG_DEBUG("Cached ETag match found, returning 304 Not Modified");
@@ -975,134 +1148,66 @@ void http_handle_request(const http_request_t *request, http_response_t *respons
                 response->is_cached = 0;
                 http_add_header(response, "ETag", cache->etag);
                 response->keep_alive = http_should_keep_alive(request);
+                cache_release(cache);
                 return;
             }
         }
 
         response->is_cached = 1;
-        response->cached_response = cache->response;
-        response->body_length = cache->response_len;
+        response->cached_object = cache;
+        response->body_length = cache->length;
         response->keep_alive = http_should_keep_alive(request);
 
         if (is_head) {
-            response->body_length = 0;
+            response->body_length = cache->header_length;
         }
 
         return;
     }
 
-    struct stat st;
-    if (stat(file_path, &st) == -1) {
-        LOG_WARN("File not found: %s", file_path);
-        response->status_code = 404;
-        response->status_text = "Not Found";
+    file_info_t *info = filecache_open(file_path);
+    if (!info) {
+        // openat2 reports components escaping the root as EXDEV and magic links as ELOOP
+        if (errno == EXDEV || errno == ELOOP) {
+            LOG_WARN("Path escapes document root: %s", file_path);
+            response->status_code = 403;
+            response->status_text = "Forbidden";
+        } else {
+            LOG_WARN("File not found: %s", file_path);
+            response->status_code = 404;
+            response->status_text = "Not Found";
+        }
         response->keep_alive = 0;
         return;
     }
+    
+    // http_serve_file() takes its own reference, so only the validators are kept here
+    const time_t mtime = info->st.st_mtime;
+    char etag[CACHE_ETAG_SIZE];
+    char last_modified[FILECACHE_LAST_MODIFIED_SIZE];
+    memcpy(etag, info->etag, sizeof(etag));
+    memcpy(last_modified, info->last_modified, sizeof(last_modified));
+    filecache_release(info);
 
-    const char* if_none_match = NULL;
-    for (int i = 0; i < request->header_count; i++) {
-        if (strcasecmp(request->headers[i][0], "If-None-Match") == 0) {
-            if_none_match = request->headers[i][1];
-            break;
-        }
-    }
-
-    const char* if_modified_since = NULL;
-    for (int i = 0; i < request->header_count; i++) {
-        if (strcasecmp(request->headers[i][0], "If-Modified-Since") == 0) {
-            if_modified_since = request->headers[i][1];
-            break;
-        }
-    }
+    size_t if_none_match_len;
+    const char *if_none_match = http_request_header(request, HTTP_HEADER_IF_NONE_MATCH, &if_none_match_len);
 
-    // Security: Generate more secure ETag using better hash
-    char etag[64];
-    char etag_input[PATH_MAX + 128]; // Ensure enough space for path + numbers
-    int written = snprintf(etag_input, sizeof(etag_input), "%s:%lu:%lu:%lu", 
-                          file_path, (unsigned long)st.st_ino, 
-                          (unsigned long)st.st_size, (unsigned long)st.st_mtime);
-    
-    // Truncate if too long (shouldn't happen with our buffer size)
-    if (written >= (int)sizeof(etag_input)) {
-        etag_input[sizeof(etag_input) - 1] = '\0';
-    }
-    
-    // Simple but better hash than just concatenation
-    unsigned long hash = 5381;
-    for (char *p = etag_input; *p; p++) {
-        hash = ((hash << 5) + hash) + *p;
+    // strptime() needs a terminated string; any valid HTTP date fits comfortably
+    char if_modified_since[64];
+    size_t if_modified_since_len;
+    const char *if_modified_since_value = http_request_header(request, HTTP_HEADER_IF_MODIFIED_SINCE, 
+                                                              &if_modified_since_len);
+    if (if_modified_since_value && if_modified_since_len < sizeof(if_modified_since)) {
+        memcpy(if_modified_since, if_modified_since_value, if_modified_since_len);
+        if_modified_since[if_modified_since_len] = '\0';
+    } else {
+        if_modified_since_value = NULL;
     }
-    
-    snprintf(etag, sizeof(etag), "\"%lx\"", hash);
 
     if (if_none_match) {
-        LOG_DEBUG("Checking ETag: client sent '%s', server has '%s'", if_none_match, etag);
+        LOG_DEBUG("Checking ETag: client sent '%.*s', server has '%s'", (int)if_none_match_len, if_none_match, etag);
         
-        char if_none_match_copy[1024];
-        strncpy(if_none_match_copy, if_none_match, sizeof(if_none_match_copy) - 1);
-        if_none_match_copy[sizeof(if_none_match_copy) - 1] = '\0';
-        
-        char *token = strtok(if_none_match_copy, ",");
-        int matched = 0;
-        
-        while (token && !matched) {
-            while (isspace(*token)) token++;
-            
-            if (strcmp(token, "*") == 0) {
-                matched = 1;
-                break;
-            }
-            
-            char clean_token[256] = {0};
-            const char *start = token;
-            if (*start == 'W' && *(start+1) == '/') {
-                start += 2;
-            }
-            
-            if (*start == '"') {
-                start++;
-                const char *end = strrchr(start, '"');
-                if (end) {
-                    size_t len = end - start;
-                    strncpy(clean_token, start, len);
-                    clean_token[len] = '\0';
-                } else {
-                    strncpy(clean_token, start, sizeof(clean_token) - 1);
-                }
-            } else {
-                strncpy(clean_token, start, sizeof(clean_token) - 1);
-            }
-            
-            char *p = clean_token + strlen(clean_token) - 1;
-            while (p >= clean_token && isspace(*p)) {
-                *p = '\0';
-                p--;
-            }
-            
-            char our_etag[64] = {0};
-            const char *etag_start = etag;
-            if (*etag_start == '"') {
-                etag_start++;
-                const char *etag_end = strrchr(etag_start, '"');
-                if (etag_end) {
-                    size_t len = etag_end - etag_start;
-                    strncpy(our_etag, etag_start, len);
-                    our_etag[len] = '\0';
-                }
-            } else {
-                strncpy(our_etag, etag_start, sizeof(our_etag) - 1);
-            }
-            
-            LOG_DEBUG("Comparing cleaned ETags: client '%s' vs server '%s'", clean_token, our_etag);
-            
-            if (strcmp(clean_token, our_etag) == 0) {
-                matched = 1;
-                break;
-            }
-            
-            token = strtok(NULL, ",");
-        }
+        int matched = http_etag_matches(if_none_match, if_none_match_len, etag);
         
         if (matched) {
             LOG_DEBUG("ETag match found, returning 304 Not Modified");
@@ -1138,7 +1243,7 @@ void http_handle_request(const http_request_t *request, http_response_t *respons
         }
     }
 
-    if (if_modified_since) {
+    if (if_modified_since_value) {
         LOG_DEBUG("Checking If-Modified-Since: %s", if_modified_since);
         
         struct tm tm_since;
@@ -1164,22 +1269,15 @@ void http_handle_request(const http_request_t *request, http_response_t *respons
             if (since_time != -1) {
                 since_time += timezone;
                 
-                struct tm *tm_file = gmtime(&st.st_mtime);
-                char file_time_str[64];
-                strftime(file_time_str, sizeof(file_time_str), "%a, %d %b %Y %H:%M:%S GMT", tm_file);
-                
                 LOG_DEBUG("Comparing times: file time %s (%ld) vs if-modified-since %s (%ld)", 
-                          file_time_str, (long)st.st_mtime, if_modified_since, (long)since_time);
+                          last_modified, (long)mtime, if_modified_since, (long)since_time);
                 
-                if (difftime(st.st_mtime, since_time) <= 0) {
+                if (difftime(mtime, since_time) <= 0) {
                     LOG_DEBUG("File not modified since %s, returning 304", if_modified_since);
                     response->status_code = 304;
                     response->status_text = "Not Modified";
                     
                     http_add_header(response, "ETag", etag);
-                    
-                    char last_modified[64];
-                    strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT", tm_file);
                     http_add_header(response, "Last-Modified", last_modified);
                     
                     http_add_header(response, "Vary", "Accept-Encoding, User-Agent");
@@ -1197,15 +1295,6 @@ void http_handle_request(const http_request_t *request, http_response_t *respons
         }
     }
 
-    const char *content_type = http_get_mime_type(file_path);
-    
-    int is_compressible = http_should_compress_mime_type(content_type);
-    
-    compression_type_t compression_type = COMPRESSION_NONE;
-    if (is_compressible) {
-        compression_type = http_negotiate_compression(request);
-    }
-    
     response->compression_type = compression_type;
 
     if (http_serve_file(file_path, response, request) != 0) {
@@ -1264,9 +1353,13 @@ void http_handle_request(const http_request_t *request, http_response_t *respons
         char timeout_str[32];
         snprintf(timeout_str, sizeof(timeout_str), "timeout=%d", config->keep_alive_timeout);
         http_add_header(response, "Keep-Alive", timeout_str);
-        LOG_DEBUG("Keep-alive enabled for request: %s %s", request->method, request->uri);
+        LOG_DEBUG("Keep-alive enabled for request: %.*s %.*s", 
+                  (int)request->method.length, HTTP_SLICE_PTR(request, request->method),
+                  (int)request->uri.length, HTTP_SLICE_PTR(request, request->uri));
     } else {
-        LOG_DEBUG("Keep-alive disabled for request: %s %s", request->method, request->uri);
+        LOG_DEBUG("Keep-alive disabled for request: %.*s %.*s", 
+                  (int)request->method.length, HTTP_SLICE_PTR(request, request->method),
+                  (int)request->uri.length, HTTP_SLICE_PTR(request, request->uri));
     }
 
     if (is_head) {
@@ -1310,19 +1403,17 @@ compression_type_t http_negotiate_compression(const http_request_t *request) {
         return COMPRESSION_NONE;
     }
     
-    for (int i = 0; i < request->header_count; i++) {
-        if (strcasecmp(request->headers[i][0], "Accept-Encoding") == 0) {
-            const char *encodings = request->headers[i][1];
-            
-            if (strstr(encodings, "gzip") != NULL) {
-                LOG_DEBUG("Client accepts gzip compression");
-                return COMPRESSION_GZIP;
-            }
-            
-            if (strstr(encodings, "deflate") != NULL) {
-                LOG_DEBUG("Client accepts deflate compression");
-                return COMPRESSION_DEFLATE;
-            }
+    size_t length;
+    const char *encodings = http_request_header(request, HTTP_HEADER_ACCEPT_ENCODING, &length);
+    if (encodings) {
+        if (memmem(encodings, length, "gzip", 4) != NULL) {
+            LOG_DEBUG("Client accepts gzip compression");
+            return COMPRESSION_GZIP;
+        }
+        
+        if (memmem(encodings, length, "deflate", 7) != NULL) {
+            LOG_DEBUG("Client accepts deflate compression");
+            return COMPRESSION_DEFLATE;
         }
     }
     
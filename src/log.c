@@ -43,6 +43,10 @@ void log_set_level(log_level_t level) {
     current_level = level;
 }
 
+int log_enabled(log_level_t level) {
+    return level >= current_level;
+}
+
 static void get_timestamp(char *buffer, size_t size) {
     struct timeval tv;
     struct tm *tm;
@@ -151,6 +151,7 @@ int main(int argc, char *argv[]) {
     }
     
     config_t *config = config_get_instance();
+    config_init(config);
     if (config_load(config, abs_config_path) != 0) {
         fprintf(stderr, "Failed to load configuration from %s\n", abs_config_path);
         return 1;
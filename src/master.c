@@ -3,6 +3,20 @@
 
 static master_t *master_instance = NULL;
 static pid_t *worker_pids = NULL;
+static int master_watch_fd = -1;
+static pthread_mutex_t listener_lock = PTHREAD_MUTEX_INITIALIZER;  // failing worker threads drop listeners
+
+typedef struct {
+    pthread_t thread;
+    master_t *master;
+    int worker_id;
+    int listen_fd;
+    int started;
+    int *alive;      // worker threads still running, shared by all slots
+    worker_t worker;
+} worker_thread_t;
+
+static pid_t fork_worker(master_t *master, int worker_id);
 
 static void handle_child_signal(int signo __attribute__((unused))) {
     pid_t pid;
@@ -14,22 +28,15 @@ static void handle_child_signal(int signo __attribute__((unused))) {
         for (int i = 0; i < master_instance->worker_count; i++) {
             if (worker_pids[i] == pid) {
                 worker_pids[i] = 0; 
+                ratelimit_reclaim_worker(i);
+                cache_reclaim_worker(i);
                 
                 if (master_instance && master_instance->is_running && !shutdown_requested && !master_instance->is_shutting_down) {
                     LOG_INFO("Restarting worker %d", i);
-                    pid_t new_pid = fork();
-                    if (new_pid == 0) {
-                        worker_t worker;
-                        if (worker_init(&worker, master_instance->server_fd, i) == 0) {
-                            worker_run(&worker);
-                            worker_cleanup(&worker);
-                        }
-                        exit(0);
-                    } else if (new_pid > 0) {
+                    pid_t new_pid = fork_worker(master_instance, i);
+                    if (new_pid > 0) {
                         worker_pids[i] = new_pid;
                         LOG_INFO("Worker %d restarted with PID %d", i, new_pid);
-                    } else {
-                        LOG_ERROR("Failed to fork worker process: %s", strerror(errno));
                     }
                 } else {
                     LOG_DEBUG("Worker %d (PID %d) exited during shutdown", i, pid);
@@ -97,6 +104,165 @@ static int configure_tcp_socket(int sockfd) {
     return 0;
 }
 
+// binds the IPv6 wildcard with IPV6_V6ONLY off so IPv4 clients arrive as v4-mapped addresses on the
+// same socket; hosts without IPv6 get a plain IPv4 listener
+static int create_listen_socket(int port) {
+    int family = AF_INET6;
+    int fd = socket(AF_INET6, SOCK_STREAM, 0);
+    if (fd == -1 && (errno == EAFNOSUPPORT || errno == EPROTONOSUPPORT)) {
+        family = AF_INET;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+    }
+    if (fd == -1) {
+        LOG_ERROR("Failed to create server socket: %s", strerror(errno));
+        return -1;
+    }
+
+    if (family == AF_INET6) {
+        int v6only = 0;
+        if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only)) == -1) {
+            LOG_ERROR("Failed to clear IPV6_V6ONLY: %s", strerror(errno));
+            close(fd);
+            return -1;
+        }
+    }
+
+    int opt = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
+        LOG_ERROR("Failed to set SO_REUSEPORT: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (configure_tcp_socket(fd) != 0) {
+        LOG_ERROR("Failed to configure TCP socket options");
+        close(fd);
+        return -1;
+    }
+
+    struct sockaddr_storage server_addr;
+    socklen_t addr_len;
+    memset(&server_addr, 0, sizeof(server_addr));
+    if (family == AF_INET6) {
+        struct sockaddr_in6 *v6 = (struct sockaddr_in6 *)&server_addr;
+        v6->sin6_family = AF_INET6;
+        v6->sin6_addr = in6addr_any;
+        v6->sin6_port = htons(port);
+        addr_len = sizeof(*v6);
+    } else {
+        struct sockaddr_in *v4 = (struct sockaddr_in *)&server_addr;
+        v4->sin_family = AF_INET;
+        v4->sin_addr.s_addr = INADDR_ANY;
+        v4->sin_port = htons(port);
+        addr_len = sizeof(*v4);
+    }
+
+    if (bind(fd, (struct sockaddr*)&server_addr, addr_len) == -1) {
+        LOG_ERROR("Failed to bind to port %d: %s", port, strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    if (listen(fd, SOMAXCONN) == -1) {
+        LOG_ERROR("Failed to listen: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// listener i belongs to worker i, pinned to CPU i % online CPUs, so the program returns the listener of a
+// worker on the CPU that received the connection; with more workers than CPUs the flow's RX hash picks one
+// of the workers sharing that CPU, and with fewer, CPUs without a worker are folded onto the others.
+// The program is attached through fd and returns group indices from master->steer_order.
+static int attach_cpu_steering(master_t *master, int fd) {
+    int num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus <= 0) {
+        LOG_WARN("Failed to get CPU count, not steering connections");
+        return -1;
+    }
+
+    uint32_t workers = master->worker_count;
+    uint32_t cpus = num_cpus;
+    // both leave the chosen worker id in A
+    struct sock_filter by_cpu[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, workers },
+    };
+    struct sock_filter by_cpu_and_hash[] = {
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+        { BPF_MISC | BPF_TAX, 0, 0, 0 },
+        { BPF_LD | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_RXHASH },
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, workers / cpus },
+        { BPF_ALU | BPF_MUL | BPF_K, 0, 0, cpus },
+        { BPF_ALU | BPF_ADD | BPF_X, 0, 0, 0 },
+    };
+    const struct sock_filter *pick = by_cpu;
+    size_t pick_len = sizeof(by_cpu) / sizeof(by_cpu[0]);
+    if (workers > cpus) {
+        pick = by_cpu_and_hash;
+        pick_len = sizeof(by_cpu_and_hash) / sizeof(by_cpu_and_hash[0]);
+        if (workers % cpus != 0) {
+            LOG_WARN("%u workers do not divide evenly over %u CPUs, the last %u receive no steered connections",
+                     workers, cpus, workers % cpus);
+        }
+    }
+
+    struct sock_filter *filter = malloc(sizeof(struct sock_filter) * (pick_len + 2 * workers + 1));
+    if (!filter) {
+        LOG_WARN("Failed to allocate reuseport CPU steering program");
+        return -1;
+    }
+    memcpy(filter, pick, sizeof(struct sock_filter) * pick_len);
+    size_t len = pick_len;
+
+    // a worker's socket sits at its position in steer_order, and a worker without one hands its share to the
+    // next worker that still has a socket
+    for (uint32_t w = 0; w < workers; w++) {
+        int index = -1;
+        for (uint32_t k = 0; k < workers && index < 0; k++) {
+            for (int i = 0; i < master->steer_size; i++) {
+                if (master->steer_order[i] == (int)((w + k) % workers)) {
+                    index = i;
+                    break;
+                }
+            }
+        }
+        filter[len++] = (struct sock_filter){ BPF_JMP | BPF_JEQ | BPF_K, 0, 1, w };
+        filter[len++] = (struct sock_filter){ BPF_RET | BPF_K, 0, 0, (uint32_t)index };
+    }
+    filter[len++] = (struct sock_filter){ BPF_RET | BPF_A, 0, 0, 0 };
+
+    struct sock_fprog prog = { .len = len, .filter = filter };
+    int rc = setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+    free(filter);
+    if (rc == -1) {
+        LOG_WARN("Failed to attach reuseport CPU steering program: %s", strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void close_listeners(master_t *master) {
+    if (master->listen_fds) {
+        for (int i = 0; i < master->worker_count; i++) {
+            if (master->listen_fds[i] != -1 && master->listen_fds[i] != master->server_fd) {
+                close(master->listen_fds[i]);
+            }
+        }
+        free(master->listen_fds);
+        master->listen_fds = NULL;
+    }
+    free(master->steer_order);
+    master->steer_order = NULL;
+
+    if (master->server_fd != -1) {
+        close(master->server_fd);
+        master->server_fd = -1;
+    }
+}
+
 static int set_worker_cpu_affinity(int worker_id) {
     int num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
     if (num_cpus <= 0) {
@@ -134,8 +300,10 @@ static pid_t fork_worker(master_t *master, int worker_id) {
             cpu_id = worker_id; 
         }
         
+        ratelimit_set_worker(worker_id);
+        cache_set_worker(worker_id);
         worker_t worker;
-        if (worker_init(&worker, master->server_fd, cpu_id) == 0) {
+        if (worker_init(&worker, master->listen_fds[worker_id], cpu_id) == 0) {
             worker_run(&worker);
             worker_cleanup(&worker);
         }
@@ -147,6 +315,127 @@ static pid_t fork_worker(master_t *master, int worker_id) {
     return pid;
 }
 
+// a worker that will not accept must leave the SO_REUSEPORT group, or the kernel keeps handing it connections
+static void drop_worker_listener(master_t *master, int worker_id) {
+    pthread_mutex_lock(&listener_lock);
+    int fd = master->listen_fds[worker_id];
+    if (fd == -1 || config_get_instance()->listen_mode == LISTEN_MODE_EXCLUSIVE) {
+        pthread_mutex_unlock(&listener_lock);
+        return;  // the shared socket still has other workers accepting on it
+    }
+    master->listen_fds[worker_id] = -1;
+    if (fd == master->server_fd) {
+        master->server_fd = -1;
+    }
+    close(fd);
+
+    if (master->steer_order) {
+        // the kernel moves the group's last socket into the index the closed one leaves
+        for (int i = 0; i < master->steer_size; i++) {
+            if (master->steer_order[i] == worker_id) {
+                master->steer_order[i] = master->steer_order[--master->steer_size];
+                break;
+            }
+        }
+        for (int i = 0; i < master->worker_count; i++) {
+            if (master->listen_fds[i] != -1) {
+                if (attach_cpu_steering(master, master->listen_fds[i]) == 0) {
+                    LOG_INFO("Steering worker %d's connections to the remaining workers", worker_id);
+                }
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&listener_lock);
+}
+
+static void *worker_thread_main(void *arg) {
+    worker_thread_t *slot = arg;
+
+    int cpu_id = set_worker_cpu_affinity(slot->worker_id);
+    if (cpu_id < 0) {
+        cpu_id = slot->worker_id;
+    }
+
+    ratelimit_set_worker(slot->worker_id);
+    cache_set_worker(slot->worker_id);
+    if (worker_init(&slot->worker, slot->listen_fd, cpu_id) == 0) {
+        worker_run(&slot->worker);
+        worker_cleanup(&slot->worker);
+    } else {
+        LOG_ERROR("Worker thread %d failed to initialize, closing its listener", slot->worker_id);
+        drop_worker_listener(slot->master, slot->worker_id);
+    }
+
+    LOG_INFO("Worker thread %d exiting", slot->worker_id);
+    __atomic_sub_fetch(slot->alive, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+// worker_mode=threads: every worker is a pinned thread of this process, so the response cache, the
+// rate-limit table and the resolver exist once; a thread that crashes takes the others with it, so
+// there is nothing to restart
+static void run_worker_threads(master_t *master) {
+    worker_thread_t *threads = calloc(master->worker_count, sizeof(worker_thread_t));
+    if (!threads) {
+        LOG_ERROR("Failed to allocate worker threads");
+        return;
+    }
+
+    int alive = 0;
+    for (int i = 0; i < master->worker_count; i++) {
+        threads[i].master = master;
+        threads[i].worker_id = i;
+        threads[i].listen_fd = master->listen_fds[i];
+        threads[i].alive = &alive;
+        __atomic_add_fetch(&alive, 1, __ATOMIC_RELAXED);
+        int rc = pthread_create(&threads[i].thread, NULL, worker_thread_main, &threads[i]);
+        if (rc != 0) {
+            LOG_ERROR("Failed to start worker thread %d: %s", i, strerror(rc));
+            __atomic_sub_fetch(&alive, 1, __ATOMIC_RELAXED);
+            drop_worker_listener(master, i);
+            continue;
+        }
+        threads[i].started = 1;
+    }
+
+    int running = __atomic_load_n(&alive, __ATOMIC_ACQUIRE);
+    LOG_INFO("Started %d worker threads", running);
+
+    time_t last_stats_time = time(NULL);
+    int stats_interval = 60;
+
+    while (master->is_running && !shutdown_requested && running > 0) {
+        sleep(1);
+
+        int now_running = __atomic_load_n(&alive, __ATOMIC_ACQUIRE);
+        if (now_running < running) {
+            LOG_WARN("%d of %d worker threads still running", now_running, master->worker_count);
+            running = now_running;
+        }
+
+        time_t now = time(NULL);
+        if (now - last_stats_time >= stats_interval) {
+            LOG_INFO("Master process running with %d worker threads", running);
+            last_stats_time = now;
+        }
+    }
+
+    LOG_INFO("Master shutting down, stopping worker threads");
+
+    master->is_shutting_down = 1;
+    shutdown_requested = 1;
+
+    for (int i = 0; i < master->worker_count; i++) {
+        if (threads[i].started) {
+            pthread_join(threads[i].thread, NULL);
+        }
+    }
+
+    free(threads);
+    LOG_INFO("All worker threads exited");
+}
+
 int master_init(master_t *master, int port, int worker_count) {
     if (!master || worker_count <= 0) {
         return -1;
@@ -159,47 +448,91 @@ int master_init(master_t *master, int port, int worker_count) {
     master->is_shutting_down = 0;
     master_instance = master;
 
-    master->server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (master->server_fd == -1) {
-        LOG_ERROR("Failed to create server socket: %s", strerror(errno));
+    master->server_fd = -1;
+
+    master->listen_fds = malloc(sizeof(int) * worker_count);
+    if (!master->listen_fds) {
+        LOG_ERROR("Failed to allocate listener array");
         return -1;
     }
+    for (int i = 0; i < worker_count; i++) {
+        master->listen_fds[i] = -1;
+    }
 
-    int opt = 1;
-    if (setsockopt(master->server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
-        LOG_ERROR("Failed to set SO_REUSEPORT: %s", strerror(errno));
-        close(master->server_fd);
-        return -1;
+    // in reuseport mode each worker gets its own socket in one SO_REUSEPORT group and the kernel spreads
+    // connections across them; the master keeps every socket open, so connections queued on a worker's
+    // socket wait for its replacement instead of being reset when it dies
+    config_t *config = config_get_instance();
+    int listener_count = config->listen_mode == LISTEN_MODE_EXCLUSIVE ? 1 : worker_count;
+    for (int i = 0; i < worker_count; i++) {
+        master->listen_fds[i] = i < listener_count ? create_listen_socket(port) : master->listen_fds[0];
+        if (master->listen_fds[i] == -1) {
+            close_listeners(master);
+            return -1;
+        }
+        if (i == 0) {
+            master->server_fd = master->listen_fds[0];
+        }
     }
 
-    if (configure_tcp_socket(master->server_fd) != 0) {
-        LOG_ERROR("Failed to configure TCP socket options");
-        close(master->server_fd);
-        return -1;
+    LOG_INFO("Listening on port %d with %d %s", port, listener_count,
+             listener_count == 1 ? "shared socket" : "SO_REUSEPORT sockets");
+
+    if (config->reuseport_cpu_steering) {
+        if (listener_count == 1) {
+            LOG_WARN("reuseport_cpu_steering needs listen_mode=reuseport and more than one worker, ignoring it");
+        } else {
+            // sockets join the group in creation order, so worker i starts out at index i
+            master->steer_order = malloc(sizeof(int) * worker_count);
+            if (master->steer_order) {
+                for (int i = 0; i < worker_count; i++) {
+                    master->steer_order[i] = i;
+                }
+                master->steer_size = worker_count;
+            }
+            if (!master->steer_order || attach_cpu_steering(master, master->server_fd) != 0) {
+                free(master->steer_order);
+                master->steer_order = NULL;
+            } else {
+                LOG_INFO("Steering connections to the worker on the receiving CPU");
+            }
+        }
     }
 
-    struct sockaddr_in server_addr;
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(port);
+    scan_init();
 
-    if (bind(master->server_fd, (struct sockaddr*)&server_addr, sizeof(server_addr)) == -1) {
-        LOG_ERROR("Failed to bind to port %d: %s", port, strerror(errno));
-        close(master->server_fd);
+    if (resolve_init(config->root_dir) != 0) {
+        close_listeners(master);
         return -1;
     }
 
-    if (listen(master->server_fd, SOMAXCONN) == -1) {
-        LOG_ERROR("Failed to listen: %s", strerror(errno));
-        close(master->server_fd);
+    // the private cache is not safe to use from several threads, so threads share the arena; each
+    // thread pins its hits in its own row (cache_set_worker()) and sends them without a copy
+    if (cache_init(config->cache_max_bytes, config->cache_size, config->cache_timeout,
+                   config->cache_shared || config->worker_mode == WORKER_MODE_THREADS, worker_count) != 0) {
+        LOG_ERROR("Failed to initialize response cache");
+        resolve_cleanup();
+        close_listeners(master);
+        return -1;
+    }
+
+    if (ratelimit_init(config->rate_limit_table_size > 0 ? config->rate_limit_table_size : 16384, worker_count,
+                       config->request_rate_limit > 0 ? config->request_rate_limit : 0,
+                       config->request_burst > 0 ? config->request_burst : 1,
+                       config->rate_limit_ipv6_prefix) != 0) {
+        cache_cleanup();
+        resolve_cleanup();
+        close_listeners(master);
         return -1;
     }
 
     worker_pids = calloc(worker_count, sizeof(pid_t));
     if (!worker_pids) {
         LOG_ERROR("Failed to allocate worker PID array");
-        close(master->server_fd);
+        ratelimit_cleanup();
+        cache_cleanup();
+        resolve_cleanup();
+        close_listeners(master);
         return -1;
     }
 
@@ -211,7 +544,10 @@ int master_init(master_t *master, int port, int worker_count) {
     if (sigaction(SIGCHLD, &sa, NULL) == -1) {
         LOG_ERROR("Failed to set up SIGCHLD handler: %s", strerror(errno));
         free(worker_pids);
-        close(master->server_fd);
+        ratelimit_cleanup();
+        cache_cleanup();
+        resolve_cleanup();
+        close_listeners(master);
         return -1;
     }
 
@@ -225,6 +561,23 @@ void master_run(master_t *master) {
 
     LOG_INFO("Starting master process with %d workers", master->worker_count);
 
+    config_t *config = config_get_instance();
+    if (config->cache_warmup) {
+        int warmed = warmup_run(config->root_dir, config->cache_warmup_max_bytes,
+                                config->cache_warmup_max_files);
+        
+        // workers respawned later fork from this cache, so keep it in step with the disk
+        if (warmed > 0 && config->cache_watch && config->worker_mode == WORKER_MODE_PROCESSES) {
+            master_watch_fd = watch_init(config->root_dir);
+        }
+    }
+
+    if (config->worker_mode == WORKER_MODE_THREADS) {
+        run_worker_threads(master);
+        LOG_INFO("Master process exiting");
+        return;
+    }
+
     for (int i = 0; i < master->worker_count; i++) {
         pid_t pid = fork_worker(master, i);
         if (pid > 0) {
@@ -239,7 +592,14 @@ void master_run(master_t *master) {
     int stats_interval = 60; 
     
     while (master->is_running && !shutdown_requested) {
-        sleep(1);
+        if (master_watch_fd != -1) {
+            struct pollfd pfd = { .fd = master_watch_fd, .events = POLLIN };
+            if (poll(&pfd, 1, 1000) > 0) {
+                watch_handle_events();
+            }
+        } else {
+            sleep(1);
+        }
         
         for (int i = 0; i < master->worker_count; i++) {
             if (worker_pids[i] <= 0) {
@@ -326,16 +686,22 @@ void master_cleanup(master_t *master) {
         return;
     }
 
-    if (master->server_fd != -1) {
-        close(master->server_fd);
-        master->server_fd = -1;
-    }
+    close_listeners(master);
 
     if (worker_pids) {
         free(worker_pids);
         worker_pids = NULL;
     }
 
+    if (master_watch_fd != -1) {
+        watch_cleanup();
+        master_watch_fd = -1;
+    }
+
+    ratelimit_cleanup();
+    cache_cleanup();
+    resolve_cleanup();
+
     master_instance = NULL;
 }
 
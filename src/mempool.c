@@ -284,7 +284,7 @@ void mempool_cleanup(mempool_t *pool) {
         free_memory(pool->memory_blocks[i], total_size);
         
         if (i + 1 < pool->num_memory_blocks) {
-            free(pool->memory_blocks[i + 1]);
+            free_memory(pool->memory_blocks[i + 1], sizeof(mem_block_t) * pool->blocks_per_pool);
         }
     }
     
@@ -0,0 +1,393 @@
+#include "ratelimit.h"
+#include "config.h"
+#include "log.h"
+#include <string.h>
+#include <errno.h>
+#include <endian.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+
+#define RATE_TOKEN_SCALE 1000  // tokens are kept in thousandths of a request
+#define RATE_TOKEN_CAPACITY ((uint64_t)RATE_LIMIT_MAX_REQUESTS * RATE_TOKEN_SCALE)
+#define RATE_TOKEN_MAX (UINT32_MAX / RATE_TOKEN_SCALE)  // whole tokens the low half of a packed word holds
+#define RATE_BUCKET_IDLE_MS ((uint64_t)RATE_LIMIT_WINDOW * 4 * 1000)
+#define RATE_TAG_BUSY (1ULL << 63)  // set while a worker fills in a bucket it has just claimed
+#define RATE_CLAIM_ATTEMPTS 2
+
+typedef struct {
+    uint64_t tag;          // hash of the key, 0 when free
+    ratelimit_key_t key;
+    uint64_t tokens;       // connections: refill time in ms (high 32 bits) | tokens (low 32 bits)
+    uint64_t requests;     // requests, packed the same way
+    uint64_t ban_until;
+    uint64_t last_seen;
+    uint32_t connections;
+    uint32_t violations;
+} __attribute__((aligned(64))) rate_bucket_t;
+
+static rate_bucket_t *buckets;
+static uint32_t set_mask;
+static size_t map_size;
+static uint16_t *held;        // worker_rows rows of slot_count: connections each worker counted per bucket
+static size_t slot_count;
+static int worker_rows;
+static __thread int current_worker = -1;
+static uint64_t request_rate;      // scaled tokens per second, 0 when requests are not limited
+static uint64_t request_capacity;
+static int ipv6_prefix = 128;
+
+static uint64_t hash_key(const ratelimit_key_t *key) {
+    uint64_t hash = key->hi * 0x9e3779b97f4a7c15ULL ^ key->lo * 0xc2b2ae3d27d4eb4fULL;
+    hash ^= hash >> 29;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    return hash ^ (hash >> 32);
+}
+
+static void format_key(const ratelimit_key_t *key, char *buffer, size_t size) {
+    if (key->hi == 0 && (key->lo >> 32) == 0xffff) {
+        struct in_addr v4 = { .s_addr = htonl((uint32_t)key->lo) };
+        inet_ntop(AF_INET, &v4, buffer, size);
+    } else {
+        uint64_t words[2] = { htobe64(key->hi), htobe64(key->lo) };
+        inet_ntop(AF_INET6, words, buffer, size);
+        if (ipv6_prefix < 128) {
+            size_t length = strlen(buffer);
+            snprintf(buffer + length, size - length, "/%d", ipv6_prefix);
+        }
+    }
+}
+
+static uint64_t pack_tokens(uint32_t stamp, uint64_t tokens) {
+    return ((uint64_t)stamp << 32) | tokens;
+}
+
+// refills amount per period_ms for the time since the last update and takes one token if there is one
+static int take_token(uint64_t *word, uint64_t capacity, uint64_t amount, uint64_t period_ms, uint64_t now_ms) {
+    uint64_t old = __atomic_load_n(word, __ATOMIC_RELAXED);
+
+    // time to refill an empty bucket; a bucket idle longer is simply full, however far the 32-bit stamp wrapped
+    uint64_t refill_ms = (capacity * period_ms + amount - 1) / amount;
+    if (refill_ms > INT32_MAX) {
+        refill_ms = INT32_MAX;
+    }
+
+    for (;;) {
+        uint32_t stamp = old >> 32;
+        uint64_t tokens = (uint32_t)old;
+
+        // another worker may have read its loop clock a little later than ours, which looks like a stamp
+        // slightly in the future rather than a bucket idle for almost a full wrap
+        uint32_t elapsed = (uint32_t)now_ms - stamp;
+        if (stamp - (uint32_t)now_ms <= refill_ms) {
+            elapsed = 0;
+        } else if (elapsed > refill_ms) {
+            elapsed = refill_ms;
+        }
+        if (elapsed > 0) {
+            tokens += (uint64_t)elapsed * amount / period_ms;
+            if (tokens > capacity) {
+                tokens = capacity;
+            }
+            stamp = (uint32_t)now_ms;
+        }
+
+        int allowed = tokens >= RATE_TOKEN_SCALE;
+        if (allowed) {
+            tokens -= RATE_TOKEN_SCALE;
+        }
+
+        if (__atomic_compare_exchange_n(word, &old, pack_tokens(stamp, tokens), 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            return allowed;
+        }
+    }
+}
+
+// takes away up to count connections, never going below zero since the bucket may have changed hands
+static void drop_connections(rate_bucket_t *bucket, uint32_t count) {
+    uint32_t connections = __atomic_load_n(&bucket->connections, __ATOMIC_RELAXED);
+    while (connections > 0 &&
+           !__atomic_compare_exchange_n(&bucket->connections, &connections,
+                                        connections > count ? connections - count : 0, 1,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static uint16_t *held_slot(int worker_id, rate_bucket_t *bucket) {
+    return &held[(size_t)worker_id * slot_count + (size_t)(bucket - buckets)];
+}
+
+static rate_bucket_t *find_bucket(rate_bucket_t *set, uint64_t tag, const ratelimit_key_t *key) {
+    for (int way = 0; way < RATE_LIMIT_WAYS; way++) {
+        rate_bucket_t *bucket = &set[way];
+        if (__atomic_load_n(&bucket->tag, __ATOMIC_ACQUIRE) == tag &&
+            bucket->key.hi == key->hi && bucket->key.lo == key->lo) {
+            return bucket;
+        }
+    }
+    return NULL;
+}
+
+// eviction order: free or expired ways, then idle clients, then connected ones, then banned ones
+static int eviction_class(rate_bucket_t *bucket, uint64_t tag, uint64_t now_ms) {
+    if (tag == 0) {
+        return 0;
+    }
+    if (tag & RATE_TAG_BUSY) {
+        return -1;
+    }
+
+    uint64_t ban_until = __atomic_load_n(&bucket->ban_until, __ATOMIC_RELAXED);
+    uint32_t connections = __atomic_load_n(&bucket->connections, __ATOMIC_RELAXED);
+    if (ban_until > now_ms) {
+        return 3;
+    }
+    if (connections > 0) {
+        return 2;
+    }
+    return now_ms > __atomic_load_n(&bucket->last_seen, __ATOMIC_RELAXED) + RATE_BUCKET_IDLE_MS ? 0 : 1;
+}
+
+static rate_bucket_t *claim_bucket(rate_bucket_t *set, uint64_t tag, const ratelimit_key_t *key, uint64_t now_ms) {
+    for (int attempt = 0; attempt < RATE_CLAIM_ATTEMPTS; attempt++) {
+        rate_bucket_t *victim = NULL;
+        uint64_t victim_tag = 0;
+        int victim_class = 4;
+        uint64_t victim_seen = 0;
+
+        for (int way = 0; way < RATE_LIMIT_WAYS; way++) {
+            rate_bucket_t *bucket = &set[way];
+            uint64_t current = __atomic_load_n(&bucket->tag, __ATOMIC_ACQUIRE);
+            if (current == tag && bucket->key.hi == key->hi && bucket->key.lo == key->lo) {
+                return bucket;
+            }
+
+            int class = eviction_class(bucket, current, now_ms);
+            uint64_t seen = __atomic_load_n(&bucket->last_seen, __ATOMIC_RELAXED);
+            if (class >= 0 && (class < victim_class || (class == victim_class && seen < victim_seen))) {
+                victim = bucket;
+                victim_tag = current;
+                victim_class = class;
+                victim_seen = seen;
+            }
+        }
+
+        if (!victim) {
+            return NULL;
+        }
+
+        if (__atomic_compare_exchange_n(&victim->tag, &victim_tag, tag | RATE_TAG_BUSY, 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+            victim->key = *key;
+            __atomic_store_n(&victim->tokens, pack_tokens((uint32_t)now_ms, RATE_TOKEN_CAPACITY), __ATOMIC_RELAXED);
+            __atomic_store_n(&victim->requests, pack_tokens((uint32_t)now_ms, request_capacity), __ATOMIC_RELAXED);
+            __atomic_store_n(&victim->ban_until, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&victim->violations, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&victim->connections, 0, __ATOMIC_RELAXED);
+            for (int worker_id = 0; worker_id < worker_rows; worker_id++) {
+                __atomic_store_n(held_slot(worker_id, victim), 0, __ATOMIC_RELAXED);
+            }
+            __atomic_store_n(&victim->last_seen, now_ms, __ATOMIC_RELAXED);
+            __atomic_store_n(&victim->tag, tag, __ATOMIC_RELEASE);
+            return victim;
+        }
+    }
+
+    return NULL;
+}
+
+int ratelimit_init(size_t entries, int workers, unsigned int requests_per_second, unsigned int request_burst,
+                   int ipv6_prefix_bits) {
+    uint32_t sets = 1;
+    while ((size_t)sets * RATE_LIMIT_WAYS < entries && sets < (1u << 24)) {
+        sets <<= 1;
+    }
+
+    size_t slots = (size_t)RATE_LIMIT_WAYS * sets;
+    int rows = workers > 0 ? workers : 0;
+    size_t size = sizeof(rate_bucket_t) * slots + sizeof(uint16_t) * slots * rows;
+    void *table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        LOG_ERROR("Failed to map rate limit table (%zu bytes): %s", size, strerror(errno));
+        return -1;
+    }
+
+    buckets = table;
+    set_mask = sets - 1;
+    map_size = size;
+    held = (uint16_t *)(buckets + slots);
+    slot_count = slots;
+    worker_rows = rows;
+    if (requests_per_second > RATE_TOKEN_MAX) {
+        LOG_WARN("request_rate_limit %u is too large, using %u", requests_per_second, RATE_TOKEN_MAX);
+        requests_per_second = RATE_TOKEN_MAX;
+    }
+    if (request_burst > RATE_TOKEN_MAX) {
+        LOG_WARN("request_burst %u is too large, using %u", request_burst, RATE_TOKEN_MAX);
+        request_burst = RATE_TOKEN_MAX;
+    }
+    request_rate = (uint64_t)requests_per_second * RATE_TOKEN_SCALE;
+    request_capacity = (uint64_t)(request_burst > 0 ? request_burst : 1) * RATE_TOKEN_SCALE;
+    if (ipv6_prefix_bits < 1 || ipv6_prefix_bits > 128) {
+        LOG_WARN("Invalid IPv6 rate limit prefix /%d, using /128", ipv6_prefix_bits);
+        ipv6_prefix_bits = 128;
+    }
+    ipv6_prefix = ipv6_prefix_bits;
+
+    LOG_INFO("Rate limit table initialized: %u sets of %d clients", sets, RATE_LIMIT_WAYS);
+    return 0;
+}
+
+void ratelimit_key(const struct sockaddr *addr, ratelimit_key_t *key) {
+    if (addr->sa_family == AF_INET6) {
+        const uint8_t *bytes = ((const struct sockaddr_in6 *)addr)->sin6_addr.s6_addr;
+        uint64_t words[2];
+        memcpy(words, bytes, sizeof(words));
+        key->hi = be64toh(words[0]);
+        key->lo = be64toh(words[1]);
+        if (key->hi == 0 && (key->lo >> 32) == 0xffff) {
+            return;  // v4-mapped, already the IPv4 key
+        }
+        if (ipv6_prefix <= 64) {
+            key->hi &= ~0ULL << (64 - ipv6_prefix);
+            key->lo = 0;
+        } else if (ipv6_prefix < 128) {
+            key->lo &= ~0ULL << (128 - ipv6_prefix);
+        }
+    } else if (addr->sa_family == AF_INET) {
+        key->hi = 0;
+        key->lo = 0xffff00000000ULL | ntohl(((const struct sockaddr_in *)addr)->sin_addr.s_addr);
+    } else {
+        key->hi = key->lo = 0;
+    }
+}
+
+// returns 1 if the client may open another connection, and counts it
+int ratelimit_acquire(const ratelimit_key_t *key, uint64_t now_ms) {
+    if (!key) return 0;
+
+    if (!buckets || config_get_instance()->development_mode) {
+        return 1;
+    }
+
+    uint64_t hash = hash_key(key);
+    uint64_t tag = (hash & ~RATE_TAG_BUSY) | 1;
+    rate_bucket_t *bucket = claim_bucket(&buckets[(hash & set_mask) * RATE_LIMIT_WAYS], tag, key, now_ms);
+    if (!bucket) {
+        return 1;
+    }
+    __atomic_store_n(&bucket->last_seen, now_ms, __ATOMIC_RELAXED);
+
+    char client_ip[INET6_ADDRSTRLEN];
+    uint64_t ban_until = __atomic_load_n(&bucket->ban_until, __ATOMIC_RELAXED);
+    if (ban_until > 0) {
+        if (now_ms < ban_until) {
+            format_key(key, client_ip, sizeof(client_ip));
+            LOG_WARN("Banned IP %s attempted connection (ban expires in %lu seconds)",
+                     client_ip, (unsigned long)((ban_until - now_ms) / 1000));
+            return 0;
+        }
+        if (__atomic_compare_exchange_n(&bucket->ban_until, &ban_until, 0, 0,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&bucket->violations, 0, __ATOMIC_RELAXED);
+            format_key(key, client_ip, sizeof(client_ip));
+            LOG_INFO("Ban expired for IP %s", client_ip);
+        }
+    }
+
+    // the slot is taken before the token so that workers racing for the last one cannot both get it
+    uint32_t connections = __atomic_load_n(&bucket->connections, __ATOMIC_RELAXED);
+    do {
+        if (connections >= MAX_CONCURRENT_CONNECTIONS_PER_IP) {
+            format_key(key, client_ip, sizeof(client_ip));
+            LOG_WARN("Too many concurrent connections from IP %s: %u", client_ip, connections);
+            return 0;
+        }
+    } while (!__atomic_compare_exchange_n(&bucket->connections, &connections, connections + 1, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    if (!take_token(&bucket->tokens, RATE_TOKEN_CAPACITY, RATE_TOKEN_CAPACITY,
+                    (uint64_t)RATE_LIMIT_WINDOW * 1000, now_ms)) {
+        drop_connections(bucket, 1);
+        uint32_t violations = __atomic_add_fetch(&bucket->violations, 1, __ATOMIC_RELAXED);
+        format_key(key, client_ip, sizeof(client_ip));
+        if (violations == MAX_VIOLATIONS_BEFORE_BAN) {
+            __atomic_store_n(&bucket->ban_until, now_ms + (uint64_t)BAN_DURATION * 1000, __ATOMIC_RELAXED);
+            LOG_WARN("IP %s banned for %d seconds after %u violations",
+                     client_ip, BAN_DURATION, violations);
+        }
+        LOG_WARN("Rate limit exceeded for IP %s: more than %d connections per %d seconds (violation #%u)",
+                 client_ip, RATE_LIMIT_MAX_REQUESTS, RATE_LIMIT_WINDOW, violations);
+        return 0;
+    }
+
+    if (current_worker >= 0) {
+        __atomic_add_fetch(held_slot(current_worker, bucket), 1, __ATOMIC_RELAXED);
+    }
+    return 1;
+}
+
+// charges one request to the client's bucket; returns 0 once it has used up its burst
+int ratelimit_request(const ratelimit_key_t *key, uint64_t now_ms) {
+    if (!buckets || request_rate == 0 || config_get_instance()->development_mode) {
+        return 1;
+    }
+
+    uint64_t hash = hash_key(key);
+    uint64_t tag = (hash & ~RATE_TAG_BUSY) | 1;
+    rate_bucket_t *bucket = find_bucket(&buckets[(hash & set_mask) * RATE_LIMIT_WAYS], tag, key);
+    if (!bucket) {
+        return 1;
+    }
+
+    return take_token(&bucket->requests, request_capacity, request_rate, 1000, now_ms);
+}
+
+void ratelimit_release(const ratelimit_key_t *key) {
+    if (!key || !buckets) return;
+
+    uint64_t hash = hash_key(key);
+    uint64_t tag = (hash & ~RATE_TAG_BUSY) | 1;
+    rate_bucket_t *bucket = find_bucket(&buckets[(hash & set_mask) * RATE_LIMIT_WAYS], tag, key);
+    if (!bucket) {
+        return;
+    }
+
+    if (current_worker >= 0) {
+        // nothing held means the bucket was reclaimed for another client since, and its count restarted
+        uint16_t *slot = held_slot(current_worker, bucket);
+        uint16_t count = __atomic_load_n(slot, __ATOMIC_RELAXED);
+        do {
+            if (count == 0) {
+                return;
+            }
+        } while (!__atomic_compare_exchange_n(slot, &count, count - 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    }
+
+    drop_connections(bucket, 1);
+}
+
+// the calling thread counts its connections as worker_id's; call it in each worker before it accepts
+void ratelimit_set_worker(int worker_id) {
+    current_worker = worker_id >= 0 && worker_id < worker_rows ? worker_id : -1;
+}
+
+// hands back every connection a dead worker still held; only call it once that worker is gone
+void ratelimit_reclaim_worker(int worker_id) {
+    if (!buckets || worker_id < 0 || worker_id >= worker_rows) return;
+
+    for (size_t i = 0; i < slot_count; i++) {
+        uint16_t count = __atomic_exchange_n(&held[(size_t)worker_id * slot_count + i], 0, __ATOMIC_RELAXED);
+        if (count > 0) {
+            drop_connections(&buckets[i], count);
+        }
+    }
+}
+
+void ratelimit_cleanup(void) {
+    if (buckets) {
+        munmap(buckets, map_size);
+        buckets = NULL;
+    }
+}
@@ -0,0 +1,178 @@
+#include "resolve.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/openat2.h>
+
+typedef struct {
+    int root_fd;
+    char root[PATH_MAX];
+    size_t root_len;
+    int use_openat2;
+} resolver_t;
+
+static resolver_t resolver = { .root_fd = -1 };
+
+static int sys_openat2(int dirfd, const char *path, int flags, uint64_t resolve) {
+#ifdef SYS_openat2
+    struct open_how how;
+    memset(&how, 0, sizeof(how));
+    how.flags = flags;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS | resolve;
+    return syscall(SYS_openat2, dirfd, path, &how, sizeof(how));
+#else
+    (void)dirfd;
+    (void)path;
+    (void)flags;
+    (void)resolve;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+int resolve_init(const char *root_dir) {
+    resolve_cleanup();
+
+    if (realpath(root_dir, resolver.root) == NULL) {
+        LOG_ERROR("Cannot resolve root directory: %s", root_dir);
+        return -1;
+    }
+
+    resolver.root_fd = open(resolver.root, O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (resolver.root_fd == -1) {
+        LOG_ERROR("Failed to open root directory %s: %s", resolver.root, strerror(errno));
+        return -1;
+    }
+
+    // keys are built as root + "/" + path, so a root of "/" contributes nothing
+    if (strcmp(resolver.root, "/") == 0) {
+        resolver.root[0] = '\0';
+    }
+    resolver.root_len = strlen(resolver.root);
+
+    int probe = sys_openat2(resolver.root_fd, ".", O_PATH | O_CLOEXEC, 0);
+    if (probe != -1) {
+        close(probe);
+        resolver.use_openat2 = 1;
+        LOG_INFO("Resolving request paths beneath %s with openat2", resolver.root_len ? resolver.root : "/");
+    } else {
+        resolver.use_openat2 = 0;
+        LOG_WARN("openat2 unavailable (%s), falling back to realpath() containment checks", strerror(errno));
+    }
+
+    return 0;
+}
+
+int resolve_path(const char *request_path, size_t length, char *path, size_t size) {
+    if (length == 0 || request_path[0] != '/') {
+        LOG_WARN("Request path is not absolute: %.*s", (int)length, request_path);
+        return -1;
+    }
+
+    if (memmem(request_path, length, "..", 2) != NULL || memchr(request_path, '\0', length) != NULL) {
+        LOG_WARN("Path traversal attempt detected: %.*s", (int)length, request_path);
+        return -1;
+    }
+
+    if (resolver.root_len >= size) {
+        return -1;
+    }
+    memcpy(path, resolver.root, resolver.root_len);
+    size_t len = resolver.root_len;
+
+    // collapse empty and "." segments and drop trailing slashes
+    const char *p = request_path;
+    const char *end = request_path + length;
+    while (p < end) {
+        while (p < end && *p == '/') p++;
+        const char *segment = p;
+        while (p < end && *p != '/') p++;
+        size_t segment_len = p - segment;
+
+        if (segment_len == 0 || (segment_len == 1 && segment[0] == '.')) {
+            continue;
+        }
+
+        if (len + 1 + segment_len >= size) {
+            LOG_ERROR("Path too long: %s%.*s", resolver.root, (int)length, request_path);
+            return -1;
+        }
+        path[len++] = '/';
+        memcpy(path + len, segment, segment_len);
+        len += segment_len;
+    }
+
+    if (len == 0) {
+        path[len++] = '/';
+    }
+    path[len] = '\0';
+
+    LOG_DEBUG("Path resolved: %.*s -> %s", (int)length, request_path, path);
+    return 0;
+}
+
+int resolve_open(const char *path, int flags, int *symlinked) {
+    if (symlinked) {
+        *symlinked = 0;
+    }
+    if (resolver.root_fd == -1) {
+        return open(path, flags);
+    }
+
+    if (strncmp(path, resolver.root, resolver.root_len) != 0 ||
+        (path[resolver.root_len] != '\0' && path[resolver.root_len] != '/')) {
+        errno = EXDEV;
+        return -1;
+    }
+
+    const char *relative = path + resolver.root_len;
+    while (*relative == '/') relative++;
+    if (*relative == '\0') {
+        relative = ".";
+    }
+
+    if (resolver.use_openat2) {
+        if (!symlinked) {
+            return sys_openat2(resolver.root_fd, relative, flags, 0);
+        }
+        int fd = sys_openat2(resolver.root_fd, relative, flags, RESOLVE_NO_SYMLINKS);
+        if (fd != -1 || errno != ELOOP) {
+            return fd;
+        }
+        *symlinked = 1;
+        return sys_openat2(resolver.root_fd, relative, flags, 0);
+    }
+
+    char canonical[PATH_MAX];
+    if (realpath(path, canonical) == NULL) {
+        return -1;
+    }
+
+    if (strncmp(canonical, resolver.root, resolver.root_len) != 0 ||
+        (canonical[resolver.root_len] != '\0' && canonical[resolver.root_len] != '/')) {
+        LOG_WARN("Path traversal attempt detected: %s resolves to %s, outside of root %s",
+                 path, canonical, resolver.root);
+        errno = EXDEV;
+        return -1;
+    }
+
+    if (symlinked) {
+        *symlinked = strcmp(canonical, path) != 0;
+    }
+    return open(canonical, flags);
+}
+
+void resolve_cleanup(void) {
+    if (resolver.root_fd != -1) {
+        close(resolver.root_fd);
+    }
+    memset(&resolver, 0, sizeof(resolver));
+    resolver.root_fd = -1;
+}
@@ -0,0 +1,174 @@
+#include "scan.h"
+#include "log.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+/*
+ * Vector kernels classify 16 or 32 bytes at a time with two table lookups:
+ * a byte is in the class when lo[byte & 0xf] & hi[byte >> 4] is non-zero.
+ * The tables are derived from the scalar class table at init, giving each
+ * distinct low-nibble pattern its own bit, so every class must have at most
+ * eight distinct patterns (the request classes need three to six).
+ */
+typedef struct {
+    size_t (*find)(const char *buffer, size_t length, scan_class_t cls);
+    const char *name;
+    uint8_t lo[SCAN_CLASS_COUNT][16];
+    uint8_t hi[SCAN_CLASS_COUNT][16];
+} scanner_t;
+
+static uint8_t byte_class[256];
+
+static size_t find_scalar(const char *buffer, size_t length, scan_class_t cls);
+
+static scanner_t scanner = { .find = find_scalar, .name = "scalar" };
+
+static int is_tchar(int c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           (c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != NULL);
+}
+
+static void build_byte_class(void) {
+    for (int c = 0; c < 256; c++) {
+        uint8_t bits = 0;
+        int ctl = c < 0x20 || c == 0x7f;
+        if (ctl || c == ' ') {
+            bits |= 1 << SCAN_REQUEST_TOKEN;
+        }
+        if (!is_tchar(c)) {
+            bits |= 1 << SCAN_HEADER_NAME;
+        }
+        if (ctl && c != '\t') {
+            bits |= 1 << SCAN_HEADER_VALUE;
+        }
+        byte_class[c] = bits;
+    }
+}
+
+static int build_nibble_tables(scan_class_t cls) {
+    uint16_t patterns[8];
+    int pattern_count = 0;
+
+    memset(scanner.lo[cls], 0, sizeof(scanner.lo[cls]));
+    memset(scanner.hi[cls], 0, sizeof(scanner.hi[cls]));
+
+    for (int hi = 0; hi < 16; hi++) {
+        uint16_t row = 0;
+        for (int lo = 0; lo < 16; lo++) {
+            if (byte_class[(hi << 4) | lo] & (1 << cls)) {
+                row |= 1 << lo;
+            }
+        }
+        if (row == 0) {
+            continue;
+        }
+
+        int bit = 0;
+        while (bit < pattern_count && patterns[bit] != row) bit++;
+        if (bit == pattern_count) {
+            if (pattern_count == 8) {
+                return -1;
+            }
+            patterns[pattern_count++] = row;
+        }
+
+        scanner.hi[cls][hi] = 1 << bit;
+        for (int lo = 0; lo < 16; lo++) {
+            if (row & (1 << lo)) {
+                scanner.lo[cls][lo] |= 1 << bit;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static size_t find_scalar(const char *buffer, size_t length, scan_class_t cls) {
+    const uint8_t mask = 1 << cls;
+    size_t i = 0;
+    while (i < length && !(byte_class[(uint8_t)buffer[i]] & mask)) i++;
+    return i;
+}
+
+#ifdef SCAN_X86
+__attribute__((target("sse4.2")))
+static size_t find_sse42(const char *buffer, size_t length, scan_class_t cls) {
+    const __m128i lo = _mm_loadu_si128((const __m128i *)scanner.lo[cls]);
+    const __m128i hi = _mm_loadu_si128((const __m128i *)scanner.hi[cls]);
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)(buffer + i));
+        __m128i lo_bits = _mm_shuffle_epi8(lo, _mm_and_si128(bytes, nibble));
+        __m128i hi_bits = _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble));
+        __m128i miss = _mm_cmpeq_epi8(_mm_and_si128(lo_bits, hi_bits), zero);
+        uint32_t hits = ~(uint32_t)_mm_movemask_epi8(miss) & 0xffff;
+        if (hits) {
+            return i + __builtin_ctz(hits);
+        }
+    }
+
+    return i + find_scalar(buffer + i, length - i, cls);
+}
+
+__attribute__((target("avx2")))
+static size_t find_avx2(const char *buffer, size_t length, scan_class_t cls) {
+    const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)scanner.lo[cls]));
+    const __m256i hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)scanner.hi[cls]));
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i *)(buffer + i));
+        __m256i lo_bits = _mm256_shuffle_epi8(lo, _mm256_and_si256(bytes, nibble));
+        __m256i hi_bits = _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(bytes, 4), nibble));
+        __m256i miss = _mm256_cmpeq_epi8(_mm256_and_si256(lo_bits, hi_bits), zero);
+        uint32_t hits = ~(uint32_t)_mm256_movemask_epi8(miss);
+        if (hits) {
+            return i + __builtin_ctz(hits);
+        }
+    }
+
+    // the 16-byte kernel picks up a remaining half block before the scalar tail
+    return i + find_sse42(buffer + i, length - i, cls);
+}
+#endif
+
+void scan_init(void) {
+    build_byte_class();
+
+    scanner.find = find_scalar;
+    scanner.name = "scalar";
+
+    for (int cls = 0; cls < SCAN_CLASS_COUNT; cls++) {
+        if (build_nibble_tables(cls) != 0) {
+            LOG_WARN("Byte class %d does not fit the vector lookup tables, using scalar scanning", cls);
+            return;
+        }
+    }
+
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scanner.find = find_avx2;
+        scanner.name = "avx2";
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        scanner.find = find_sse42;
+        scanner.name = "sse4.2";
+    }
+#endif
+
+    LOG_INFO("Request scanner: %s", scanner.name);
+}
+
+size_t scan_find(const char *buffer, size_t length, scan_class_t cls) {
+    return scanner.find(buffer, length, cls);
+}
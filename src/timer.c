@@ -0,0 +1,158 @@
+#include "timer.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TIMER_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void link_entry(timer_wheel_t *wheel, int id, int list) {
+    timer_entry_t *entry = &wheel->entries[id];
+    entry->list = list;
+    entry->prev = -1;
+    entry->next = wheel->heads[list];
+    if (entry->next != -1) {
+        wheel->entries[entry->next].prev = id;
+    }
+    wheel->heads[list] = id;
+}
+
+static void unlink_entry(timer_wheel_t *wheel, int id) {
+    timer_entry_t *entry = &wheel->entries[id];
+    if (entry->prev != -1) {
+        wheel->entries[entry->prev].next = entry->next;
+    } else {
+        wheel->heads[entry->list] = entry->next;
+    }
+    if (entry->next != -1) {
+        wheel->entries[entry->next].prev = entry->prev;
+    }
+    entry->list = -1;
+}
+
+// moves the due entries of one slot to the expired list, leaving those a revolution or more away
+static void collect_slot(timer_wheel_t *wheel, int slot, uint32_t now_tick) {
+    int id = wheel->heads[slot];
+    while (id != -1) {
+        int next = wheel->entries[id].next;
+        if (wheel->entries[id].tick <= now_tick) {
+            unlink_entry(wheel, id);
+            link_entry(wheel, id, TIMER_WHEEL_SLOTS);
+        }
+        id = next;
+    }
+}
+
+int timer_wheel_init(timer_wheel_t *wheel, int capacity) {
+    memset(wheel, 0, sizeof(*wheel));
+
+    wheel->entries = malloc(sizeof(timer_entry_t) * capacity);
+    if (!wheel->entries) {
+        LOG_ERROR("Failed to allocate timer wheel (%d entries)", capacity);
+        return -1;
+    }
+    for (int i = 0; i < capacity; i++) {
+        wheel->entries[i].list = -1;
+    }
+    for (int i = 0; i <= TIMER_WHEEL_SLOTS; i++) {
+        wheel->heads[i] = -1;
+    }
+
+    wheel->capacity = capacity;
+    wheel->now_ms = monotonic_ms();
+    wheel->tick = wheel->now_ms / TIMER_TICK_MS;
+
+    return 0;
+}
+
+void timer_wheel_update(timer_wheel_t *wheel) {
+    wheel->now_ms = monotonic_ms();
+
+    uint32_t now_tick = wheel->now_ms / TIMER_TICK_MS;
+    uint32_t steps = now_tick - wheel->tick;
+    if (steps > TIMER_WHEEL_SLOTS) {
+        steps = TIMER_WHEEL_SLOTS;
+    }
+
+    for (uint32_t i = 1; i <= steps; i++) {
+        collect_slot(wheel, (wheel->tick + i) & TIMER_SLOT_MASK, now_tick);
+    }
+    wheel->tick = now_tick;
+}
+
+void timer_wheel_schedule(timer_wheel_t *wheel, int id, uint64_t delay_ms) {
+    if (id < 0 || id >= wheel->capacity) {
+        return;
+    }
+
+    if (wheel->entries[id].list != -1) {
+        unlink_entry(wheel, id);
+    } else {
+        wheel->count++;
+    }
+
+    // round up so a deadline never fires early; the slot for the current tick has already been collected
+    uint32_t tick = (wheel->now_ms + delay_ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    if (tick <= wheel->tick) {
+        tick = wheel->tick + 1;
+    }
+
+    wheel->entries[id].tick = tick;
+    link_entry(wheel, id, tick & TIMER_SLOT_MASK);
+}
+
+void timer_wheel_cancel(timer_wheel_t *wheel, int id) {
+    if (id < 0 || id >= wheel->capacity || wheel->entries[id].list == -1) {
+        return;
+    }
+
+    unlink_entry(wheel, id);
+    wheel->count--;
+}
+
+int timer_wheel_next_expired(timer_wheel_t *wheel) {
+    int id = wheel->heads[TIMER_WHEEL_SLOTS];
+    if (id != -1) {
+        unlink_entry(wheel, id);
+        wheel->count--;
+    }
+    return id;
+}
+
+// milliseconds until the first occupied slot comes due, as the epoll_wait timeout
+int timer_wheel_timeout(const timer_wheel_t *wheel, int max_ms) {
+    if (wheel->heads[TIMER_WHEEL_SLOTS] != -1) {
+        return 0;
+    }
+    if (wheel->count == 0) {
+        return max_ms;
+    }
+
+    uint32_t horizon = max_ms / TIMER_TICK_MS + 1;
+    if (horizon > TIMER_WHEEL_SLOTS) {
+        horizon = TIMER_WHEEL_SLOTS;
+    }
+
+    for (uint32_t i = 1; i <= horizon; i++) {
+        if (wheel->heads[(wheel->tick + i) & TIMER_SLOT_MASK] != -1) {
+            uint64_t due_ms = (uint64_t)(wheel->tick + i) * TIMER_TICK_MS;
+            int wait = due_ms > wheel->now_ms ? (int)(due_ms - wheel->now_ms) : 0;
+            return wait < max_ms ? wait : max_ms;
+        }
+    }
+
+    return max_ms;
+}
+
+void timer_wheel_cleanup(timer_wheel_t *wheel) {
+    free(wheel->entries);
+    wheel->entries = NULL;
+    wheel->capacity = 0;
+    wheel->count = 0;
+}
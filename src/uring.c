@@ -0,0 +1,389 @@
+#include "uring.h"
+#include "log.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                          void *arg, size_t arg_size) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// publishes queued entries and optionally waits; a timeout or signal is not an error here
+static int uring_enter(uring_t *ring, unsigned wait_nr, int timeout_ms) {
+    unsigned to_submit = ring->sq_local_tail - *ring->sq_tail;
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+
+    unsigned flags = 0;
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    memset(&arg, 0, sizeof(arg));
+
+    if (wait_nr > 0) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+    }
+
+    if (io_uring_enter(ring->fd, to_submit, wait_nr, flags, wait_nr > 0 ? &arg : NULL,
+                       wait_nr > 0 ? sizeof(arg) : 0) == -1) {
+        if (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN) {
+            return 0;
+        }
+        LOG_ERROR("io_uring_enter failed: %s", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head >= ring->sq_entries) {
+        // submission ring is full, hand the queued entries over before taking another
+        if (uring_enter(ring, 0, 0) != 0) {
+            return NULL;
+        }
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sq_local_tail - head >= ring->sq_entries) {
+            LOG_ERROR("io_uring submission queue full");
+            return NULL;
+        }
+    }
+
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sq_local_tail & *ring->sq_mask];
+    ring->sq_local_tail++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static int uring_setup_buffers(uring_t *ring, unsigned count, size_t size) {
+    size_t ring_size = sizeof(struct io_uring_buf) * count;
+    void *map = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("Failed to allocate io_uring buffer ring: %s", strerror(errno));
+        return -1;
+    }
+    ring->buffers = map;
+
+    map = mmap(NULL, count * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("Failed to allocate io_uring receive buffers: %s", strerror(errno));
+        return -1;
+    }
+    ring->buffer_memory = map;
+    ring->buffer_count = count;
+    ring->buffer_size = size;
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->buffers;
+    reg.ring_entries = count;
+    reg.bgid = 0;
+    if (io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        LOG_WARN("Failed to register io_uring buffer ring: %s", strerror(errno));
+        return -1;
+    }
+
+    for (unsigned i = 0; i < count; i++) {
+        uring_buffer_return(ring, (int)i);
+    }
+
+    return 0;
+}
+
+int uring_init(uring_t *ring, unsigned entries, int file_slots, unsigned buffer_count, size_t buffer_size) {
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+
+    // single issuer, submit-all and provided buffer rings together mean 6.0 or later, which has every multishot request used here
+    static const unsigned setup_flags[] = {
+        IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+        IORING_SETUP_SUBMIT_ALL | IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN,
+    };
+
+    struct io_uring_params params;
+    for (size_t i = 0; i < sizeof(setup_flags) / sizeof(setup_flags[0]) && ring->fd == -1; i++) {
+        memset(&params, 0, sizeof(params));
+        params.flags = setup_flags[i] | IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 4;
+        ring->fd = io_uring_setup(entries, &params);
+    }
+    if (ring->fd == -1) {
+        LOG_WARN("io_uring_setup failed: %s", strerror(errno));
+        return -1;
+    }
+
+    if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        LOG_WARN("io_uring lacks timed waits or overflow protection");
+        uring_cleanup(ring);
+        return -1;
+    }
+
+    ring->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_size > ring->sq_map_size) {
+            ring->sq_map_size = ring->cq_map_size;
+        }
+        ring->cq_map_size = ring->sq_map_size;
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        ring->sq_map = NULL;
+        LOG_ERROR("Failed to map io_uring submission ring: %s", strerror(errno));
+        uring_cleanup(ring);
+        return -1;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_map = ring->sq_map;
+    } else {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED) {
+            ring->cq_map = NULL;
+            LOG_ERROR("Failed to map io_uring completion ring: %s", strerror(errno));
+            uring_cleanup(ring);
+            return -1;
+        }
+    }
+
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        LOG_ERROR("Failed to map io_uring submission entries: %s", strerror(errno));
+        uring_cleanup(ring);
+        return -1;
+    }
+
+    char *sq = ring->sq_map;
+    char *cq = ring->cq_map;
+    ring->sq_entries = params.sq_entries;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->sq_local_tail = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+
+    // entries are always used in ring order, so the indirection array is the identity
+    for (unsigned i = 0; i < params.sq_entries; i++) {
+        ring->sq_array[i] = i;
+    }
+
+    struct io_uring_rsrc_register files;
+    memset(&files, 0, sizeof(files));
+    files.nr = file_slots;
+    files.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (io_uring_register(ring->fd, IORING_REGISTER_FILES2, &files, sizeof(files)) == -1) {
+        LOG_WARN("Failed to register io_uring file table (%d slots): %s", file_slots, strerror(errno));
+        uring_cleanup(ring);
+        return -1;
+    }
+    ring->file_slots = file_slots;
+
+    ring->file_updates = malloc(sizeof(int) * ring->sq_entries);
+    if (!ring->file_updates) {
+        LOG_ERROR("Failed to allocate io_uring file updates");
+        uring_cleanup(ring);
+        return -1;
+    }
+
+    if (uring_setup_buffers(ring, buffer_count, buffer_size) != 0) {
+        uring_cleanup(ring);
+        return -1;
+    }
+
+    return 0;
+}
+
+void uring_cleanup(uring_t *ring) {
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_map && ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if (ring->sq_map) {
+        munmap(ring->sq_map, ring->sq_map_size);
+    }
+    // closing the ring cancels whatever is still in flight and drops the registered files
+    if (ring->fd != -1) {
+        close(ring->fd);
+    }
+    if (ring->buffers) {
+        munmap(ring->buffers, sizeof(struct io_uring_buf) * ring->buffer_count);
+    }
+    if (ring->buffer_memory) {
+        munmap(ring->buffer_memory, ring->buffer_count * ring->buffer_size);
+    }
+    free(ring->file_updates);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+// the update runs inline when it is submitted, so requests queued after it already see the new slot;
+// like a cancel it only completes visibly when it fails
+static int uring_update_file(uring_t *ring, int slot, int fd) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+    // the kernel reads the descriptor when the entry is submitted, by which time the caller's copy is gone
+    unsigned index = (unsigned)(sqe - ring->sqes);
+    ring->file_updates[index] = fd;
+    sqe->opcode = IORING_OP_FILES_UPDATE;
+    sqe->fd = -1;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->addr = (uint64_t)(uintptr_t)&ring->file_updates[index];
+    sqe->len = 1;
+    sqe->off = slot;
+    sqe->user_data = 0;
+    return 0;
+}
+
+int uring_register_fd(uring_t *ring, int fd) {
+    if (fd < 0 || fd >= ring->file_slots) {
+        return -1;
+    }
+    return uring_update_file(ring, fd, fd);
+}
+
+int uring_unregister_fd(uring_t *ring, int fd) {
+    if (fd < 0 || fd >= ring->file_slots) {
+        return -1;
+    }
+    return uring_update_file(ring, fd, -1);
+}
+
+// a multishot accept would write every peer into one address buffer, so each accept in flight gets its own
+int uring_accept(uring_t *ring, int fd, struct sockaddr *addr, socklen_t *addr_len, uint64_t user_data) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->addr2 = (uint64_t)(uintptr_t)addr_len;
+    sqe->accept_flags = SOCK_NONBLOCK;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+// fd is both the descriptor and its registered file slot
+int uring_recv_multishot(uring_t *ring, int fd, uint64_t user_data) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->buf_group = 0;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+// fd is a registered file slot; msg and what it points to must stay put until the send completes
+int uring_sendmsg(uring_t *ring, int fd, const struct msghdr *msg, int flags, uint64_t user_data) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_FIXED_FILE;
+    sqe->addr = (uint64_t)(uintptr_t)msg;
+    sqe->len = 1;
+    sqe->msg_flags = flags | MSG_NOSIGNAL;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+int uring_poll(uring_t *ring, int fd, int fixed, uint32_t events, int multishot, uint64_t user_data) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->flags = fixed ? IOSQE_FIXED_FILE : 0;
+    sqe->poll32_events = events;
+    sqe->len = multishot ? IORING_POLL_ADD_MULTI : 0;
+    sqe->user_data = user_data;
+    return 0;
+}
+
+// the cancel request itself only completes visibly when it fails, with user data 0
+int uring_cancel(uring_t *ring, uint64_t user_data) {
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        return -1;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->addr = user_data;
+    sqe->user_data = 0;
+    return 0;
+}
+
+int uring_wait(uring_t *ring, int timeout_ms) {
+    return uring_enter(ring, 1, timeout_ms);
+}
+
+int uring_next(uring_t *ring, uring_completion_t *completion) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return 0;
+    }
+
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+    completion->user_data = cqe->user_data;
+    completion->res = cqe->res;
+    completion->more = (cqe->flags & IORING_CQE_F_MORE) != 0;
+    completion->buffer = (cqe->flags & IORING_CQE_F_BUFFER) ? (int)(cqe->flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+
+    __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+const char *uring_buffer_data(uring_t *ring, int buffer) {
+    return ring->buffer_memory + (size_t)buffer * ring->buffer_size;
+}
+
+void uring_buffer_return(uring_t *ring, int buffer) {
+    struct io_uring_buf *buf = &ring->buffers->bufs[ring->buffer_tail & (ring->buffer_count - 1)];
+    buf->addr = (uint64_t)(uintptr_t)uring_buffer_data(ring, buffer);
+    buf->len = ring->buffer_size;
+    buf->bid = buffer;
+    ring->buffer_tail++;
+    __atomic_store_n(&ring->buffers->tail, ring->buffer_tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,108 @@
+#include "warmup.h"
+#include "http.h"
+#include "cache.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+typedef struct {
+    size_t max_bytes;
+    int max_files;
+    size_t bytes;
+    int files;
+} warmup_budget_t;
+
+static int budget_exhausted(const warmup_budget_t *budget) {
+    return budget->bytes >= budget->max_bytes || budget->files >= budget->max_files;
+}
+
+static void warmup_file(const char *path, const struct stat *st, warmup_budget_t *budget) {
+    // mirror the conditions under which http_serve_file() caches a response
+    if (st->st_size >= MAX_CACHEABLE_FILE_SIZE || !strrchr(path, '.')) {
+        return;
+    }
+
+    if (budget->bytes + st->st_size > budget->max_bytes) {
+        return;
+    }
+
+    // charge what the cache actually took, so the response headers and both encodings count
+    size_t stored = cache_stored_bytes();
+    if (http_preload_file(path, COMPRESSION_NONE) != 0) {
+        return;
+    }
+
+    if (http_should_compress_mime_type(http_get_mime_type(path)) &&
+        budget->bytes + (cache_stored_bytes() - stored) + st->st_size <= budget->max_bytes) {
+        http_preload_file(path, COMPRESSION_GZIP);
+    }
+
+    budget->bytes += cache_stored_bytes() - stored;
+    budget->files++;
+    LOG_DEBUG("Warmed cache with %s", path);
+}
+
+// files of a directory are loaded before its subdirectories so shallow assets win when the budget is tight
+static void warmup_dir(const char *path, warmup_budget_t *budget) {
+    DIR *dir = opendir(path);
+    if (!dir) {
+        LOG_WARN("Failed to scan %s for cache warm-up: %s", path, strerror(errno));
+        return;
+    }
+
+    for (int pass = 0; pass < 2 && !budget_exhausted(budget); pass++) {
+        struct dirent *entry;
+        rewinddir(dir);
+
+        while ((entry = readdir(dir)) != NULL && !budget_exhausted(budget)) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+
+            char child[PATH_MAX];
+            if (snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) >= (int)sizeof(child)) {
+                continue;
+            }
+
+            // symlinks are skipped: responses reached through them are never cached
+            struct stat st;
+            if (lstat(child, &st) != 0) {
+                continue;
+            }
+
+            if (pass == 0 && S_ISREG(st.st_mode)) {
+                warmup_file(child, &st, budget);
+            } else if (pass == 1 && S_ISDIR(st.st_mode)) {
+                warmup_dir(child, budget);
+            }
+        }
+    }
+
+    closedir(dir);
+}
+
+int warmup_run(const char *root_dir, size_t max_bytes, int max_files) {
+    char canonical_root[PATH_MAX];
+    if (realpath(root_dir, canonical_root) == NULL) {
+        LOG_ERROR("Cannot resolve root directory for cache warm-up: %s", root_dir);
+        return -1;
+    }
+
+    warmup_budget_t budget = {
+        .max_bytes = max_bytes,
+        .max_files = max_files,
+        .bytes = 0,
+        .files = 0,
+    };
+
+    time_t start = time(NULL);
+    warmup_dir(canonical_root, &budget);
+
+    LOG_INFO("Cache warm-up loaded %d files (%zu bytes) from %s in %lds",
+             budget.files, budget.bytes, canonical_root, (long)(time(NULL) - start));
+    return budget.files;
+}
@@ -0,0 +1,231 @@
+#include "watch.h"
+#include "cache.h"
+#include "filecache.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define WATCH_FILE_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_DELETE | \
+                           IN_MOVED_FROM | IN_MOVED_TO)
+#define WATCH_EVENT_MASK (WATCH_FILE_EVENTS | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW)
+#define WATCH_BUFFER_SIZE 16384
+
+typedef struct {
+    int fd;
+    char **dirs;
+    int dir_capacity;
+} watch_t;
+
+// each worker watches for itself, since it also has to drop entries from its own open file cache
+static __thread watch_t watch = { .fd = -1 };
+
+// directories are tracked by watch descriptor, which the kernel hands out as small increasing integers
+static int watch_add_dir(const char *path) {
+    int wd = inotify_add_watch(watch.fd, path, WATCH_EVENT_MASK);
+    if (wd == -1) {
+        if (errno == ENOSPC) {
+            LOG_WARN("Out of inotify watches at %s, raise fs.inotify.max_user_watches", path);
+        } else {
+            LOG_WARN("Failed to watch %s: %s", path, strerror(errno));
+        }
+        return -1;
+    }
+
+    if (wd >= watch.dir_capacity) {
+        int capacity = watch.dir_capacity ? watch.dir_capacity : 64;
+        while (capacity <= wd) {
+            capacity *= 2;
+        }
+        char **dirs = realloc(watch.dirs, sizeof(char *) * capacity);
+        if (!dirs) {
+            LOG_ERROR("Failed to allocate watch table");
+            inotify_rm_watch(watch.fd, wd);
+            return -1;
+        }
+        memset(dirs + watch.dir_capacity, 0, sizeof(char *) * (capacity - watch.dir_capacity));
+        watch.dirs = dirs;
+        watch.dir_capacity = capacity;
+    }
+
+    // re-adding a directory that was moved returns its old descriptor, so the path is replaced
+    char *copy = strdup(path);
+    if (!copy) {
+        LOG_ERROR("Failed to allocate watch path");
+        return -1;
+    }
+    free(watch.dirs[wd]);
+    watch.dirs[wd] = copy;
+    return 0;
+}
+
+static int watch_add_tree(const char *path) {
+    if (watch_add_dir(path) != 0) {
+        return -1;
+    }
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        LOG_WARN("Failed to scan %s for watching: %s", path, strerror(errno));
+        return 0;
+    }
+
+    struct dirent *entry;
+    int result = 0;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        char child[PATH_MAX];
+        if (snprintf(child, sizeof(child), "%s/%s", path, entry->d_name) >= (int)sizeof(child)) {
+            continue;
+        }
+
+        int is_dir = (entry->d_type == DT_DIR);
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat st;
+            is_dir = (lstat(child, &st) == 0 && S_ISDIR(st.st_mode));
+        }
+
+        if (is_dir && watch_add_tree(child) != 0) {
+            result = -1;
+            break;
+        }
+    }
+
+    closedir(dir);
+    return result;
+}
+
+int watch_init(const char *root_dir) {
+    // a worker inherits the master's watch across fork; it needs its own event queue
+    watch_cleanup();
+
+    char canonical_root[PATH_MAX];
+    if (realpath(root_dir, canonical_root) == NULL) {
+        LOG_ERROR("Cannot resolve root directory for watching: %s", root_dir);
+        return -1;
+    }
+
+    watch.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch.fd == -1) {
+        LOG_ERROR("Failed to create inotify instance: %s", strerror(errno));
+        return -1;
+    }
+
+    if (watch_add_tree(canonical_root) != 0) {
+        LOG_WARN("Could not watch all of %s, falling back to cache_timeout expiry", canonical_root);
+        watch_cleanup();
+        return -1;
+    }
+
+    LOG_INFO("Watching %s for changes", canonical_root);
+    return watch.fd;
+}
+
+static void watch_handle_event(const struct inotify_event *event) {
+    if (event->mask & IN_Q_OVERFLOW) {
+        LOG_WARN("inotify queue overflowed, flushing response cache");
+        cache_flush();
+        filecache_flush();
+        return;
+    }
+
+    if (event->wd < 0 || event->wd >= watch.dir_capacity || !watch.dirs[event->wd]) {
+        return;
+    }
+
+    if (event->mask & IN_IGNORED) {
+        free(watch.dirs[event->wd]);
+        watch.dirs[event->wd] = NULL;
+        return;
+    }
+
+    if (event->len == 0) {
+        if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+            cache_flush();
+            filecache_flush();
+        }
+        return;
+    }
+
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", watch.dirs[event->wd], event->name) >= (int)sizeof(path)) {
+        return;
+    }
+
+    if (!(event->mask & IN_ISDIR)) {
+        LOG_DEBUG("File changed, invalidating cache: %s", path);
+        cache_invalidate(path);
+        filecache_invalidate(path);
+
+        // cached responses for the base file may have been built from this precompressed sidecar, or without it
+        size_t len = strlen(path);
+        if (len > 3 && (strcmp(path + len - 3, ".gz") == 0 || strcmp(path + len - 3, ".br") == 0)) {
+            path[len - 3] = '\0';
+            cache_invalidate(path);
+        }
+        return;
+    }
+
+    if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+        if (watch_add_tree(path) != 0) {
+            LOG_WARN("New directory %s is not fully watched", path);
+        }
+    }
+
+    // a directory moving or vanishing can affect any number of entries below it
+    if (event->mask & (IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_ATTRIB)) {
+        LOG_DEBUG("Directory changed, flushing response cache: %s", path);
+        cache_flush();
+        filecache_flush();
+    }
+}
+
+void watch_handle_events(void) {
+    char buffer[WATCH_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+
+    for (;;) {
+        ssize_t len = read(watch.fd, buffer, sizeof(buffer));
+        if (len == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                LOG_ERROR("Failed to read inotify events: %s", strerror(errno));
+            }
+            return;
+        }
+        if (len == 0) {
+            return;
+        }
+
+        const struct inotify_event *event;
+        for (char *p = buffer; p < buffer + len; p += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)p;
+            watch_handle_event(event);
+        }
+    }
+}
+
+void watch_cleanup(void) {
+    if (watch.fd != -1) {
+        close(watch.fd);
+    }
+
+    for (int i = 0; i < watch.dir_capacity; i++) {
+        free(watch.dirs[i]);
+    }
+    free(watch.dirs);
+
+    watch.fd = -1;
+    watch.dirs = NULL;
+    watch.dir_capacity = 0;
+}
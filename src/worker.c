@@ -4,6 +4,13 @@ extern void setup_signal_handlers(void);
 
 static volatile sig_atomic_t worker_shutdown_requested = 0;
 
+static const char too_many_requests[] =
+    "HTTP/1.1 429 Too Many Requests\r\n"
+    "X-Content-Type-Options: nosniff\r\n"
+    "Retry-After: 1\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n\r\n";
+
 static void worker_signal_handler(int signo) {
     switch (signo) {
         case SIGTERM:
@@ -18,208 +25,226 @@ static void worker_signal_handler(int signo) {
     }
 }
 
-static rate_limit_entry_t rate_limit_table[RATE_LIMIT_TABLE_SIZE];
-static pthread_mutex_t rate_limit_mutex = PTHREAD_MUTEX_INITIALIZER;
-
-static unsigned int hash_ip(const char *ip) {
-    unsigned int hash = 5381;
-    int c;
-    while ((c = *ip++)) {
-        hash = ((hash << 5) + hash) + c;
+static int set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1) {
+        LOG_ERROR("Failed to get socket flags: %s", strerror(errno));
+        return -1;
     }
-    return hash % RATE_LIMIT_TABLE_SIZE;
-}
-
-static int check_rate_limit(const char *client_ip) {
-    if (!client_ip) return 0;
     
-    config_t *config = config_get_instance();
-    if (config->development_mode) {
-        return 1;
+    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        LOG_ERROR("Failed to set non-blocking mode: %s", strerror(errno));
+        return -1;
     }
     
-    pthread_mutex_lock(&rate_limit_mutex);
-    
-    unsigned int hash = hash_ip(client_ip);
-    rate_limit_entry_t *entry = &rate_limit_table[hash];
-    time_t now = time(NULL);
+    return 0;
+}
+
+static int add_to_epoll(worker_t *worker, int fd, uint32_t events) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.fd = fd;
     
-    if (entry->ban_until > 0 && now < entry->ban_until) {
-        pthread_mutex_unlock(&rate_limit_mutex);
-        LOG_WARN("Banned IP %s attempted connection (ban expires in %ld seconds)", 
-                 client_ip, entry->ban_until - now);
-        return 0;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        LOG_ERROR("Failed to add fd to epoll: %s", strerror(errno));
+        return -1;
     }
     
-    if (entry->ban_until > 0 && now >= entry->ban_until) {
-        entry->ban_until = 0;
-        entry->violation_count = 0;
-        LOG_INFO("Ban expired for IP %s", client_ip);
-    }
+    LOG_DEBUG("Epoll add: fd=%d, events=0x%x", fd, events);
     
-    if (entry->ip[0] == '\0' || strcmp(entry->ip, client_ip) != 0 || 
-        (now - entry->window_start) > RATE_LIMIT_WINDOW * 2) {
-        strncpy(entry->ip, client_ip, sizeof(entry->ip) - 1);
-        entry->ip[sizeof(entry->ip) - 1] = '\0';
-        entry->window_start = now;
-        entry->request_count = 1;
-        entry->last_request = now;
-        entry->connection_count = 1;
-        pthread_mutex_unlock(&rate_limit_mutex);
-        return 1;
+    return 0;
+}
+
+static int remove_from_epoll(worker_t *worker, int fd) {
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, fd, NULL) == -1) {
+        LOG_ERROR("Failed to remove fd from epoll: %s", strerror(errno));
+        return -1;
     }
     
-    if (entry->connection_count >= MAX_CONCURRENT_CONNECTIONS_PER_IP) {
-        pthread_mutex_unlock(&rate_limit_mutex);
-        LOG_WARN("Too many concurrent connections from IP %s: %d", 
-                 client_ip, entry->connection_count);
-        return 0;
-    }
+    LOG_DEBUG("Epoll remove: fd=%d", fd);
     
-    if ((now - entry->window_start) >= RATE_LIMIT_WINDOW) {
-        entry->window_start = now;
-        entry->request_count = 1;
-        entry->last_request = now;
-        entry->connection_count++;
-        pthread_mutex_unlock(&rate_limit_mutex);
-        return 1;
+    return 0;
+}
+
+static client_conn_t *worker_find_client(worker_t *worker, int fd) {
+    if (fd < 0 || fd >= worker->fd_table_size || worker->fd_table[fd] == 0) {
+        return NULL;
     }
-    
-    entry->request_count++;
-    entry->last_request = now;
-    entry->connection_count++;
-    
-    if (entry->request_count > RATE_LIMIT_MAX_REQUESTS) {
-        entry->violation_count++;
-        
-        if (entry->violation_count >= MAX_VIOLATIONS_BEFORE_BAN) {
-            entry->ban_until = now + BAN_DURATION;
-            LOG_WARN("IP %s banned for %d seconds after %d violations", 
-                     client_ip, BAN_DURATION, entry->violation_count);
+    return &worker->clients[worker->fd_table[fd] - 1];
+}
+
+static void worker_index_client(worker_t *worker, int index) {
+    worker->fd_table[worker->clients[index].fd] = index + 1;
+}
+
+// arms the one timer a connection has for whatever it is waiting on now
+static void worker_set_deadline(worker_t *worker, client_conn_t *client) {
+    int seconds;
+    
+    if (client->output) {
+        client->deadline = DEADLINE_SEND;
+        seconds = SEND_TIMEOUT;
+    } else if (client->buffer_consumed < client->buffer_used) {
+        // measured from the first byte of the request, not refreshed by later ones
+        if (client->deadline == DEADLINE_REQUEST) {
+            return;
         }
-        
-        pthread_mutex_unlock(&rate_limit_mutex);
-        LOG_WARN("Rate limit exceeded for IP %s: %d requests in window (violation #%d)", 
-                 client_ip, entry->request_count, entry->violation_count);
-        return 0;
+        client->deadline = DEADLINE_REQUEST;
+        seconds = SLOW_LORIS_TIMEOUT;
+    } else {
+        client->deadline = DEADLINE_IDLE;
+        seconds = worker->keep_alive_timeout;
     }
     
-    pthread_mutex_unlock(&rate_limit_mutex);
-    return 1;
+    timer_wheel_schedule(&worker->timers, client->fd, (uint64_t)seconds * 1000);
 }
 
-static void decrement_connection_count(const char *client_ip) {
-    if (!client_ip) return;
-    
-    pthread_mutex_lock(&rate_limit_mutex);
-    
-    unsigned int hash = hash_ip(client_ip);
-    rate_limit_entry_t *entry = &rate_limit_table[hash];
+static int worker_take_input(worker_t *worker, client_conn_t *client) {
+    if (client->input) {
+        return 0;
+    }
     
-    if (entry->ip[0] != '\0' && strcmp(entry->ip, client_ip) == 0) {
-        if (entry->connection_count > 0) {
-            entry->connection_count--;
-            LOG_DEBUG("Decremented connection count for IP %s: %d", 
-                      client_ip, entry->connection_count);
-        }
+    client->input = mempool_alloc(&worker->buffer_pool);
+    if (!client->input) {
+        LOG_ERROR("Failed to allocate receive buffer for fd=%d", client->fd);
+        return -1;
     }
     
-    pthread_mutex_unlock(&rate_limit_mutex);
+    http_parser_reset(&client->input->parser);
+    client->input->spill = NULL;
+    client->input->spill_length = 0;
+    client->buffer_used = 0;
+    client->buffer_consumed = 0;
+    
+    return 0;
 }
 
-static void cleanup_rate_limit_table(void) {
-    pthread_mutex_lock(&rate_limit_mutex);
-    
-    time_t now = time(NULL);
-    int cleaned = 0;
-    
-    for (int i = 0; i < RATE_LIMIT_TABLE_SIZE; i++) {
-        rate_limit_entry_t *entry = &rate_limit_table[i];
-        
-        if (entry->ip[0] != '\0' && 
-            entry->ban_until == 0 && 
-            (now - entry->last_request) > (RATE_LIMIT_WINDOW * 4)) {
-            memset(entry, 0, sizeof(rate_limit_entry_t));
-            cleaned++;
-        }
+static void worker_free_input(worker_t *worker, client_conn_t *client) {
+    if (client->input) {
+        free(client->input->spill);
+        mempool_free(&worker->buffer_pool, client->input);
+        client->input = NULL;
     }
-    
-    if (cleaned > 0) {
-        LOG_DEBUG("Cleaned %d old rate limit entries", cleaned);
+}
+
+// hands the receive buffer back to the pool once nothing in it is waiting to be answered
+static void worker_release_input(worker_t *worker, client_conn_t *client) {
+    if (client->input && client->buffer_used == 0 && !client->input->spill) {
+        worker_free_input(worker, client);
     }
-    
-    pthread_mutex_unlock(&rate_limit_mutex);
 }
 
+enum {
+    URING_ACCEPT = 1,
+    URING_RECV,
+    URING_POLLOUT,
+    URING_SEND,
+    URING_WATCH
+};
 
-static int set_nonblocking(int fd) {
-    int flags = fcntl(fd, F_GETFL, 0);
-    if (flags == -1) {
-        LOG_ERROR("Failed to get socket flags: %s", strerror(errno));
+// completion tag: request type, low 24 bits of the connection generation, descriptor
+#define URING_TAG(type, generation, fd) \
+    (((uint64_t)(type) << 56) | ((uint64_t)((generation) & 0xffffff) << 32) | (uint32_t)(fd))
+#define URING_TAG_TYPE(tag) ((int)((tag) >> 56))
+#define URING_TAG_GENERATION(tag) ((uint32_t)((tag) >> 32) & 0xffffff)
+#define URING_TAG_FD(tag) ((int)(uint32_t)(tag))
+
+static int worker_uring_arm_recv(worker_t *worker, client_conn_t *client) {
+    if (uring_recv_multishot(worker->ring, client->fd, URING_TAG(URING_RECV, client->generation, client->fd)) != 0) {
         return -1;
     }
-    
-    if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
-        LOG_ERROR("Failed to set non-blocking mode: %s", strerror(errno));
+    client->uring_pending |= CLIENT_URING_RECV;
+    return 0;
+}
+
+static int worker_uring_arm_poll(worker_t *worker, client_conn_t *client) {
+    if (uring_poll(worker->ring, client->fd, 1, POLLOUT, 0,
+                   URING_TAG(URING_POLLOUT, client->generation, client->fd)) != 0) {
         return -1;
     }
-    
+    client->uring_pending |= CLIENT_URING_POLL;
     return 0;
 }
 
-static int create_timeout_timer(int timeout_seconds) {
-    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
-    if (timer_fd == -1) {
-        LOG_ERROR("Failed to create timer: %s", strerror(errno));
-        return -1;
+// starts delivering input for a newly accepted client
+static int worker_watch_client(worker_t *worker, client_conn_t *client) {
+    if (!worker->ring) {
+        return add_to_epoll(worker, client->fd, EPOLLIN | EPOLLET | EPOLLRDHUP);
     }
     
-    struct itimerspec its;
-    its.it_interval.tv_sec = timeout_seconds;
-    its.it_interval.tv_nsec = 0;
-    its.it_value.tv_sec = timeout_seconds;
-    its.it_value.tv_nsec = 0;
-    
-    if (timerfd_settime(timer_fd, 0, &its, NULL) == -1) {
-        LOG_ERROR("Failed to set timer: %s", strerror(errno));
-        close(timer_fd);
+    client->generation = worker->next_generation++;
+    client->uring_pending = 0;
+    if (uring_register_fd(worker->ring, client->fd) != 0) {
         return -1;
     }
-    
-    return timer_fd;
+    if (worker_uring_arm_recv(worker, client) != 0) {
+        uring_unregister_fd(worker->ring, client->fd);
+        return -1;
+    }
+    return 0;
 }
 
-static int add_to_epoll(worker_t *worker, int fd, uint32_t events) {
-    struct epoll_event ev;
-    ev.events = events;
-    ev.data.fd = fd;
-    
-    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
-        LOG_ERROR("Failed to add fd to epoll: %s", strerror(errno));
-        return -1;
+static void worker_unwatch_client(worker_t *worker, client_conn_t *client) {
+    if (!worker->ring) {
+        remove_from_epoll(worker, client->fd);
+        return;
     }
     
-    LOG_DEBUG("Epoll add: fd=%d, events=0x%x", fd, events);
-    
-    return 0;
+    // completions still on their way are told apart by the generation in their tag
+    if (client->uring_pending & CLIENT_URING_RECV) {
+        uring_cancel(worker->ring, URING_TAG(URING_RECV, client->generation, client->fd));
+    }
+    if (client->uring_pending & CLIENT_URING_POLL) {
+        uring_cancel(worker->ring, URING_TAG(URING_POLLOUT, client->generation, client->fd));
+    }
+    if (client->uring_pending & CLIENT_URING_SEND) {
+        uring_cancel(worker->ring, URING_TAG(URING_SEND, client->generation, client->fd));
+    }
+    uring_unregister_fd(worker->ring, client->fd);
 }
 
-static int remove_from_epoll(worker_t *worker, int fd) {
-    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, fd, NULL) == -1) {
-        LOG_ERROR("Failed to remove fd from epoll: %s", strerror(errno));
-        return -1;
+// drops a connection's unsent responses; a batch the kernel may still be reading waits for its send to complete
+static void worker_drop_output(worker_t *worker, client_conn_t *client) {
+    client_send_t *send = client->send;
+    if (send && (client->uring_pending & CLIENT_URING_SEND)) {
+        send->tag = URING_TAG(URING_SEND, client->generation, client->fd);
+        send->next = worker->orphaned_sends;
+        worker->orphaned_sends = send;
+    } else if (send) {
+        http_output_clear(&send->queue);
+        send->next = worker->free_sends;
+        worker->free_sends = send;
+    } else if (client->output) {
+        http_output_clear(client->output);
+        free(client->output);
+    }
+    client->send = NULL;
+    client->output = NULL;
+}
+
+// a response would block, so wait for the socket to drain instead of reading more requests
+static int worker_wait_writable(worker_t *worker, client_conn_t *client) {
+    if (worker->ring) {
+        // bytes the receive delivers before the cancel lands are spilled until the response is out
+        if ((client->uring_pending & CLIENT_URING_RECV) &&
+            uring_cancel(worker->ring, URING_TAG(URING_RECV, client->generation, client->fd)) != 0) {
+            return -1;
+        }
+        return worker_uring_arm_poll(worker, client);
     }
     
-    LOG_DEBUG("Epoll remove: fd=%d", fd);
+    struct epoll_event ev;
+    ev.events = EPOLLOUT | EPOLLET | EPOLLRDHUP;
+    ev.data.fd = client->fd;
     
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev) == -1) {
+        LOG_ERROR("Failed to modify client epoll events for write: %s", strerror(errno));
+        return -1;
+    }
     return 0;
 }
 
-int worker_init(worker_t *worker, int server_fd, int cpu_id) {
-    memset(worker, 0, sizeof(worker_t));
-    
-    worker_shutdown_requested = 0;
-    
+static int worker_install_signal_handlers(void) {
     struct sigaction sa;
     memset(&sa, 0, sizeof(sa));
     sa.sa_handler = worker_signal_handler;
@@ -241,6 +266,19 @@ int worker_init(worker_t *worker, int server_fd, int cpu_id) {
         return -1;
     }
     
+    return 0;
+}
+
+int worker_init(worker_t *worker, int server_fd, int cpu_id) {
+    memset(worker, 0, sizeof(worker_t));
+    
+    worker_shutdown_requested = 0;
+    
+    // worker threads share the process, and with it the master's signal handlers
+    if (config_get_instance()->worker_mode == WORKER_MODE_PROCESSES && worker_install_signal_handlers() != 0) {
+        return -1;
+    }
+    
     signal(SIGPIPE, SIG_IGN);
     
     cpu_set_t cpuset;
@@ -252,7 +290,7 @@ int worker_init(worker_t *worker, int server_fd, int cpu_id) {
     }
     worker->cpu_id = cpu_id;
     
-    if (mempool_init(&worker->buffer_pool, BUFFER_SIZE, BUFFER_POOL_SIZE) != 0) {
+    if (mempool_init(&worker->buffer_pool, sizeof(client_input_t), BUFFER_POOL_SIZE) != 0) {
         LOG_ERROR("Failed to initialize buffer pool");
         return -1;
     }
@@ -270,7 +308,17 @@ int worker_init(worker_t *worker, int server_fd, int cpu_id) {
         return -1;
     }
     
-    if (add_to_epoll(worker, server_fd, EPOLLIN | EPOLLET) == -1) {
+    uint32_t listen_events = EPOLLIN | EPOLLET;
+    if (config_get_instance()->listen_mode == LISTEN_MODE_EXCLUSIVE) {
+        // every worker waits on the same listener, so have the kernel wake only one of them per connection
+        if (add_to_epoll(worker, server_fd, listen_events | EPOLLEXCLUSIVE) == 0) {
+            listen_events = 0;
+        } else {
+            LOG_WARN("EPOLLEXCLUSIVE is not supported, every worker wakes for each connection");
+        }
+    }
+    
+    if (listen_events && add_to_epoll(worker, server_fd, listen_events) == -1) {
         mempool_cleanup(&worker->buffer_pool);
         close(worker->epoll_fd);
         return -1;
@@ -297,19 +345,81 @@ int worker_init(worker_t *worker, int server_fd, int cpu_id) {
         return -1;
     }
     
+    // descriptors never exceed the soft limit, so a table of that size indexes every one of them
+    struct rlimit rlim;
+    worker->fd_table_size = getrlimit(RLIMIT_NOFILE, &rlim) == 0 && rlim.rlim_cur != RLIM_INFINITY &&
+                            rlim.rlim_cur < (rlim_t)INT_MAX ? (int)rlim.rlim_cur : MAX_CONNECTIONS * 2 + 64;
+    worker->fd_table = calloc(worker->fd_table_size, sizeof(int));
+    if (!worker->fd_table) {
+        LOG_ERROR("Failed to allocate fd table (%d entries)", worker->fd_table_size);
+        mempool_cleanup(&worker->buffer_pool);
+        free(worker->events);
+        free(worker->clients);
+        close(worker->epoll_fd);
+        return -1;
+    }
+    
+    if (timer_wheel_init(&worker->timers, worker->fd_table_size) != 0) {
+        mempool_cleanup(&worker->buffer_pool);
+        free(worker->events);
+        free(worker->clients);
+        free(worker->fd_table);
+        close(worker->epoll_fd);
+        return -1;
+    }
+    worker->now = worker->timers.now_ms / 1000;
+    
     worker->connection_pool = malloc(sizeof(int) * CONNECTION_POOL_SIZE);
     if (!worker->connection_pool) {
         LOG_ERROR("Failed to allocate connection pool");
         mempool_cleanup(&worker->buffer_pool);
+        timer_wheel_cleanup(&worker->timers);
         free(worker->events);
         free(worker->clients);
+        free(worker->fd_table);
         close(worker->epoll_fd);
         return -1;
     }
     worker->pool_size = CONNECTION_POOL_SIZE;
     worker->pool_count = 0;
     
-    LOG_INFO("Worker running on CPU %d", worker->cpu_id);
+    config_t *config = config_get_instance();
+    if (config->keep_alive_timeout > 0) {
+        worker->keep_alive_timeout = config->keep_alive_timeout;
+    }
+    
+    worker->count_steering = config->reuseport_cpu_steering;
+    
+    if (config->event_backend == EVENT_BACKEND_IO_URING) {
+        // the kernel refuses registered file tables beyond 2^20 slots
+        int file_slots = worker->fd_table_size < (1 << 20) ? worker->fd_table_size : (1 << 20);
+        worker->ring = malloc(sizeof(uring_t));
+        worker->accepts = calloc(URING_ACCEPT_SLOTS, sizeof(uring_accept_t));
+        if (!worker->ring || !worker->accepts ||
+            uring_init(worker->ring, URING_ENTRIES, file_slots, URING_BUFFER_COUNT, URING_BUFFER_SIZE) != 0) {
+            LOG_WARN("io_uring is unavailable, worker on CPU %d falls back to epoll", cpu_id);
+            free(worker->ring);
+            worker->ring = NULL;
+            free(worker->accepts);
+            worker->accepts = NULL;
+        }
+    }
+    
+    if (filecache_init(config->open_file_cache_size > 0 ? config->open_file_cache_size : 0,
+                       config->open_file_cache_valid) != 0) {
+        LOG_WARN("Continuing without open file cache");
+    }
+    
+    worker->watch_fd = -1;
+    if (config->cache_watch) {
+        worker->watch_fd = watch_init(config->root_dir);
+        if (worker->watch_fd != -1 && add_to_epoll(worker, worker->watch_fd, EPOLLIN) == -1) {
+            watch_cleanup();
+            worker->watch_fd = -1;
+        }
+    }
+    
+    LOG_INFO("Worker running on CPU %d (%s)", worker->cpu_id, worker->ring ? "io_uring" : "epoll");
     
     return 0;
 }
@@ -364,122 +474,134 @@ int worker_add_client(worker_t *worker, int client_fd) {
         return -1;
     }
     
-    char *buffer = mempool_alloc(&worker->buffer_pool);
-    if (!buffer) {
-        LOG_ERROR("Failed to allocate buffer from pool");
-        return -1;
-    }
-    
-    int timer_fd = create_timeout_timer(worker->keep_alive_timeout);
-    if (timer_fd == -1) {
-        mempool_free(&worker->buffer_pool, buffer);
-        return -1;
-    }
-    
-    if (add_to_epoll(worker, timer_fd, EPOLLIN | EPOLLET) == -1) {
-        mempool_free(&worker->buffer_pool, buffer);
-        close(timer_fd);
-        return -1;
-    }
-    
     worker->clients[worker->client_count].fd = client_fd;
-    worker->clients[worker->client_count].timer_fd = timer_fd;
-    worker->clients[worker->client_count].last_activity = time(NULL);
-    worker->clients[worker->client_count].buffer = buffer;
+    worker->clients[worker->client_count].deadline = DEADLINE_NONE;
+    worker->clients[worker->client_count].last_activity = worker->now;
+    worker->clients[worker->client_count].input = NULL;
+    worker->clients[worker->client_count].output = NULL;
+    worker->clients[worker->client_count].send = NULL;
+    worker->clients[worker->client_count].buffer_used = 0;
+    worker->clients[worker->client_count].buffer_consumed = 0;
     worker->clients[worker->client_count].keep_alive = 1; 
-    worker->clients[worker->client_count].has_pending_response = 0;
+    worker_index_client(worker, worker->client_count);
+    worker_set_deadline(worker, &worker->clients[worker->client_count]);
     worker->client_count++;
     
-    LOG_DEBUG("Buffer allocated for fd=%d", client_fd);
-    
     return 0;
 }
 
 void worker_remove_client(worker_t *worker, int client_fd) {
-    for (int i = 0; i < worker->client_count; i++) {
-        if (worker->clients[i].fd == client_fd) {
-            remove_from_epoll(worker, client_fd);
-            remove_from_epoll(worker, worker->clients[i].timer_fd);
-            
-            decrement_connection_count(worker->clients[i].client_ip);
-            
-            if (worker->clients[i].buffer) {
-                mempool_free(&worker->buffer_pool, worker->clients[i].buffer);
-                LOG_DEBUG("Buffer freed for fd=%d", client_fd);
-            }
-            
-            if (worker->clients[i].has_pending_response) {
-                http_free_response(&worker->clients[i].pending_response);
-                worker->clients[i].has_pending_response = 0;
-            }
-            
-            close(client_fd);
-            close(worker->clients[i].timer_fd);
-            
-            if (i < worker->client_count - 1) {
-                worker->clients[i] = worker->clients[worker->client_count - 1];
-            }
-            worker->client_count--;
-            
-            LOG_INFO("Closed connection: fd=%d, clients=%d", client_fd, worker->client_count);
-            
-            break;
-        }
+    client_conn_t *client = worker_find_client(worker, client_fd);
+    if (!client || client->fd != client_fd) {
+        return;
+    }
+    int i = client - worker->clients;
+    
+    worker_unwatch_client(worker, client);
+    timer_wheel_cancel(&worker->timers, client_fd);
+    
+    ratelimit_release(&client->rate_key);
+    
+    worker_free_input(worker, client);
+    worker_drop_output(worker, client);
+    
+    worker->fd_table[client_fd] = 0;
+    close(client_fd);
+    
+    // the last client moves into the hole, so its fd must follow it
+    if (i < worker->client_count - 1) {
+        worker->clients[i] = worker->clients[worker->client_count - 1];
+        worker_index_client(worker, i);
     }
+    worker->client_count--;
+    
+    LOG_INFO("Closed connection: fd=%d, clients=%d", client_fd, worker->client_count);
 }
 
-void worker_handle_timeout(worker_t *worker, int timer_fd) {
-    for (int i = 0; i < worker->client_count; i++) {
-        if (worker->clients[i].timer_fd == timer_fd) {
-            time_t now = time(NULL);
-            
-            if (worker->clients[i].bytes_received > 0 && 
-                worker->clients[i].bytes_received < 4 &&
-                (now - worker->clients[i].connection_start) >= SLOW_LORIS_TIMEOUT) {
-                LOG_WARN("Slow loris attack detected from %s: incomplete request after %ld seconds", 
-                         worker->clients[i].client_ip, now - worker->clients[i].connection_start);
-                worker_remove_client(worker, worker->clients[i].fd);
-                break;
-            }
-            
-            if (now - worker->clients[i].last_activity >= worker->keep_alive_timeout) {
-                LOG_INFO("Client timeout: fd=%d, ip=%s, idle=%lds", 
-                         worker->clients[i].fd, worker->clients[i].client_ip,
-                         now - worker->clients[i].last_activity);
-                worker_remove_client(worker, worker->clients[i].fd);
-            }
+void worker_handle_timeout(worker_t *worker, int client_fd) {
+    client_conn_t *client = worker_find_client(worker, client_fd);
+    if (!client || client->fd != client_fd) {
+        return;
+    }
+    
+    switch (client->deadline) {
+        case DEADLINE_REQUEST:
+            LOG_WARN("Slow loris attack detected from %s: incomplete request after %d seconds", 
+                     worker_client_address(client), SLOW_LORIS_TIMEOUT);
+            break;
+        case DEADLINE_SEND:
+            LOG_INFO("Send timeout: fd=%d, ip=%s, no progress for %ds", 
+                     client_fd, worker_client_address(client), SEND_TIMEOUT);
+            break;
+        default:
+            LOG_INFO("Client timeout: fd=%d, ip=%s, idle=%lds", 
+                     client_fd, worker_client_address(client),
+                     worker->now - client->last_activity);
             break;
+    }
+    
+    worker_remove_client(worker, client_fd);
+}
+
+// renders the peer for a log line into a per-thread buffer that the next call overwrites
+const char *worker_client_address(const client_conn_t *client) {
+    static __thread char text[INET6_ADDRSTRLEN];
+    const struct sockaddr_storage *addr = &client->client_addr;
+    
+    if (addr->ss_family == AF_INET6) {
+        const struct in6_addr *v6 = &((const struct sockaddr_in6 *)addr)->sin6_addr;
+        if (IN6_IS_ADDR_V4MAPPED(v6)) {
+            inet_ntop(AF_INET, &v6->s6_addr[12], text, sizeof(text));
+        } else {
+            inet_ntop(AF_INET6, v6, text, sizeof(text));
         }
+    } else if (addr->ss_family == AF_INET) {
+        inet_ntop(AF_INET, &((const struct sockaddr_in *)addr)->sin_addr, text, sizeof(text));
+    } else {
+        strcpy(text, "unknown");
+    }
+    return text;
+}
+
+static int client_port(const struct sockaddr_storage *addr) {
+    if (addr->ss_family == AF_INET6) {
+        return ntohs(((const struct sockaddr_in6 *)addr)->sin6_port);
+    }
+    if (addr->ss_family == AF_INET) {
+        return ntohs(((const struct sockaddr_in *)addr)->sin_port);
     }
+    return 0;
 }
 
-void worker_handle_connection(worker_t *worker, int client_fd) {
+// returns -1 after closing the socket if it could not become a client
+int worker_handle_connection(worker_t *worker, int client_fd, const struct sockaddr_storage *addr,
+                             const ratelimit_key_t *rate_key) {
     int opt = 1;
     
     if (setsockopt(client_fd, SOL_SOCKET, SO_KEEPALIVE, &opt, sizeof(opt)) < 0) {
         LOG_ERROR("Failed to set SO_KEEPALIVE for client: %s", strerror(errno));
         close(client_fd);
-        return;
+        return -1;
     }
     
     if (setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt)) < 0) {
         LOG_ERROR("Failed to set TCP_NODELAY for client: %s", strerror(errno));
         close(client_fd);
-        return;
+        return -1;
     }
     
     int snd_buf = 65536;
     if (setsockopt(client_fd, SOL_SOCKET, SO_SNDBUF, &snd_buf, sizeof(snd_buf)) < 0) {
         LOG_ERROR("Failed to set SO_SNDBUF for client: %s", strerror(errno));
         close(client_fd);
-        return;
+        return -1;
     }
     
     int rcv_buf = 65536;
     if (setsockopt(client_fd, SOL_SOCKET, SO_RCVBUF, &rcv_buf, sizeof(rcv_buf)) < 0) {
         LOG_ERROR("Failed to set SO_RCVBUF for client: %s", strerror(errno));
         close(client_fd);
-        return;
+        return -1;
     }
     
     int keepidle = 60;  
@@ -489,298 +611,563 @@ void worker_handle_connection(worker_t *worker, int client_fd) {
     if (setsockopt(client_fd, IPPROTO_TCP, TCP_KEEPIDLE, &keepidle, sizeof(keepidle)) < 0) {
         LOG_ERROR("Failed to set TCP_KEEPIDLE for client: %s", strerror(errno));
         close(client_fd);
-        return;
+        return -1;
     }
     
     if (setsockopt(client_fd, IPPROTO_TCP, TCP_KEEPINTVL, &keepintvl, sizeof(keepintvl)) < 0) {
         LOG_ERROR("Failed to set TCP_KEEPINTVL for client: %s", strerror(errno));
         close(client_fd);
-        return;
+        return -1;
     }
     
     if (setsockopt(client_fd, IPPROTO_TCP, TCP_KEEPCNT, &keepcnt, sizeof(keepcnt)) < 0) {
         LOG_ERROR("Failed to set TCP_KEEPCNT for client: %s", strerror(errno));
         close(client_fd);
-        return;
+        return -1;
     }
     
     if (set_nonblocking(client_fd) == -1) {
         LOG_ERROR("Failed to set non-blocking mode for client: %s", strerror(errno));
         close(client_fd);
-        return;
-    }
-    
-    struct epoll_event ev;
-    ev.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
-    ev.data.fd = client_fd;
-    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, client_fd, &ev) == -1) {
-        LOG_ERROR("Failed to add client to epoll: %s", strerror(errno));
-        close(client_fd);
-        return;
-    }
-    
-    int timer_fd = create_timeout_timer(worker->keep_alive_timeout);
-    if (timer_fd == -1) {
-        LOG_ERROR("Failed to create timeout timer for client");
-        close(client_fd);
-        return;
-    }
-    
-    ev.events = EPOLLIN;
-    ev.data.fd = timer_fd;
-    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, timer_fd, &ev) == -1) {
-        LOG_ERROR("Failed to add timer to epoll: %s", strerror(errno));
-        close(timer_fd);
-        close(client_fd);
-        return;
-    }
-    
-    char *buffer = mempool_alloc(&worker->buffer_pool);
-    if (!buffer) {
-        LOG_ERROR("Failed to allocate buffer for client");
-        close(timer_fd);
-        close(client_fd);
-        return;
+        return -1;
     }
     
     if (worker->client_count >= MAX_CONNECTIONS) {
         LOG_WARN("Connection limit reached, rejecting new connection");
-        mempool_free(&worker->buffer_pool, buffer);
-        close(timer_fd);
         close(client_fd);
-        return;
+        return -1;
     }
     
-    time_t now = time(NULL);
+    time_t now = worker->now;
     worker->clients[worker->client_count].fd = client_fd;
-    worker->clients[worker->client_count].timer_fd = timer_fd;
+    worker->clients[worker->client_count].deadline = DEADLINE_NONE;
     worker->clients[worker->client_count].last_activity = now;
-    worker->clients[worker->client_count].buffer = buffer;
+    worker->clients[worker->client_count].input = NULL;
+    worker->clients[worker->client_count].output = NULL;
+    worker->clients[worker->client_count].send = NULL;
+    worker->clients[worker->client_count].buffer_used = 0;
+    worker->clients[worker->client_count].buffer_consumed = 0;
     worker->clients[worker->client_count].keep_alive = 1;
-    worker->clients[worker->client_count].has_pending_response = 0;
     worker->clients[worker->client_count].connection_start = now;
     worker->clients[worker->client_count].bytes_received = 0;
     
-    struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
-    if (getpeername(client_fd, (struct sockaddr*)&client_addr, &addr_len) == 0) {
-        inet_ntop(AF_INET, &client_addr.sin_addr, 
-                  worker->clients[worker->client_count].client_ip, 
-                  INET_ADDRSTRLEN);
-        LOG_INFO("Accepted connection: fd=%d, ip=%s, port=%d, clients=%d", 
-                 client_fd, worker->clients[worker->client_count].client_ip, 
-                 ntohs(client_addr.sin_port), worker->client_count + 1);
-    } else {
-        strcpy(worker->clients[worker->client_count].client_ip, "unknown");
+    worker->clients[worker->client_count].client_addr = *addr;
+    worker->clients[worker->client_count].rate_key = *rate_key;
+    LOG_INFO("Accepted connection: fd=%d, ip=%s, port=%d, clients=%d", 
+             client_fd, worker_client_address(&worker->clients[worker->client_count]), 
+             client_port(addr), worker->client_count + 1);
+    
+    if (worker_watch_client(worker, &worker->clients[worker->client_count]) == -1) {
+        LOG_ERROR("Failed to watch client fd=%d", client_fd);
+        close(client_fd);
+        return -1;
     }
     
+    worker_index_client(worker, worker->client_count);
+    worker_set_deadline(worker, &worker->clients[worker->client_count]);
     worker->client_count++;
-    
-    LOG_DEBUG("Buffer allocated for fd=%d", client_fd);
+    return 0;
 }
 
-void worker_handle_client_data(worker_t *worker, int client_fd) {
-    client_conn_t *client = NULL;
-    for (int i = 0; i < worker->client_count; i++) {
-        if (worker->clients[i].fd == client_fd) {
-            client = &worker->clients[i];
-            break;
+// the ring writes the batch in the background, so it leaves the batch queue for a send buffer of the client's own
+static int worker_uring_start_send(worker_t *worker, client_conn_t *client) {
+    client_send_t *send = worker->free_sends;
+    if (send) {
+        worker->free_sends = send->next;
+    } else {
+        send = malloc(sizeof(client_send_t));
+        if (!send) {
+            LOG_ERROR("Failed to allocate pending output for fd=%d", client->fd);
+            http_output_clear(&worker->output);
+            return -1;
         }
     }
-    if (!client || !client->buffer) {
-        return;
-    }
-
-    ssize_t bytes_read;
-    int total_read = 0;
-    int __attribute__((unused)) processed = 0;
-
-    while ((bytes_read = recv(client_fd, client->buffer + total_read, BUFFER_SIZE - total_read - 1, 0)) > 0) {
-        total_read += bytes_read;
-        client->bytes_received += bytes_read;
-        
-        if ((size_t)total_read >= BUFFER_SIZE - 1) {
-            LOG_WARN("Request too large from %s: %d bytes", client->client_ip, total_read);
-            break;
+    
+    send->queue = worker->output;
+    worker->output.head = 0;
+    worker->output.count = 0;
+    client->send = send;
+    client->output = &send->queue;
+    
+    return http_output_detach(client->output, send->headers, sizeof(send->headers));
+}
+
+// hands the in-memory part of client->output to the ring as one gathered send and writes file bodies with
+// sendfile(); returns 1 once everything is out, 0 while a send or a poll is pending
+static int worker_uring_flush(worker_t *worker, client_conn_t *client) {
+    client_send_t *send = client->send;
+    
+    while (send->queue.count > 0) {
+        int more;
+        int iovcnt = http_output_gather(&send->queue, send->iov, &more);
+        if (iovcnt > 0) {
+            memset(&send->msg, 0, sizeof(send->msg));
+            send->msg.msg_iov = send->iov;
+            send->msg.msg_iovlen = iovcnt;
+            if (uring_sendmsg(worker->ring, client->fd, &send->msg, more ? MSG_MORE : 0,
+                              URING_TAG(URING_SEND, client->generation, client->fd)) != 0) {
+                return -1;
+            }
+            client->uring_pending |= CLIENT_URING_SEND;
+            return 0;
         }
         
-        if (bytes_read == 1 && client->bytes_received > 100) {
-            time_t now = time(NULL);
-            if ((now - client->connection_start) > 5) {
-                LOG_WARN("Potential slow loris attack from %s: %d single-byte reads", 
-                         client->client_ip, client->bytes_received);
-                worker_remove_client(worker, client_fd);
-                return;
-            }
+        int result = http_output_send_file(client->fd, &send->queue);
+        if (result == 0) {
+            return worker_wait_writable(worker, client) == 0 ? 0 : -1;
+        } else if (result < 0) {
+            return -1;
         }
     }
+    
+    return 1;
+}
 
-    if (total_read > 0) {
-        client->buffer[total_read] = '\0';
-        client->last_activity = time(NULL);
-        int offset = 0;
-        
-        while (offset < total_read) {
-            char *end = strstr(client->buffer + offset, "\r\n\r\n");
-            if (!end) {
-                if (offset > 0 && offset < total_read) {
-                    memmove(client->buffer, client->buffer + offset, total_read - offset);
-                }
+// answers every complete request in the buffer; returns -1 once the client is gone or its responses are still being written
+static int worker_process_requests(worker_t *worker, client_conn_t *client) {
+    int client_fd = client->fd;
+    http_output_queue_t *output = &worker->output;
+    
+    for (;;) {
+        // responses to all complete requests are queued first and written together
+        while (client->keep_alive && output->count < HTTP_OUTPUT_QUEUE_SIZE &&
+               client->buffer_consumed < client->buffer_used) {
+            http_parser_t *parser = &client->input->parser;
+            int parse_result = http_parse_request(parser, client->input->data + client->buffer_consumed,
+                                                  client->buffer_used - client->buffer_consumed);
+            if (parse_result == -4) {
+                // Incomplete request, the parser resumes where it stopped once more bytes arrive
                 break;
             }
-
-            int req_len = end - (client->buffer + offset) + 4;
             
-            http_request_t request;
-            int parse_result = http_parse_request(client->buffer + offset, req_len, &request);
-            if (parse_result != 0) {
-                http_response_t response;
-                
-                if (parse_result == -2) {
-                    // Request too large
-                    LOG_WARN("Request too large from %s (fd=%d)", client->client_ip, client_fd);
-                    http_create_response(&response, 413);
-                } else if (parse_result == -3) {
-                    // Unsupported HTTP version
-                    LOG_WARN("Unsupported HTTP version from %s (fd=%d)", client->client_ip, client_fd);
-                    http_create_response(&response, 505);
-                } else {
-                    // Malformed request
-                    LOG_WARN("Malformed HTTP request from %s (fd=%d)", client->client_ip, client_fd);
-                    http_create_response(&response, 400);
+            if (parse_result == 0 && !ratelimit_request(&client->rate_key, worker->timers.now_ms)) {
+                // past its request burst the client gets a canned answer and loses the connection
+                LOG_WARN("Request rate exceeded by %s (fd=%d)", worker_client_address(client), client_fd);
+                http_parser_reset(parser);
+                client->buffer_consumed = client->buffer_used;
+                client->keep_alive = 0;
+                if (http_output_push_static(output, too_many_requests, sizeof(too_many_requests) - 1) != 0) {
+                    http_output_clear(output);
+                    worker_remove_client(worker, client_fd);
+                    return -1;
                 }
-                
-                response.keep_alive = 0;
-                http_send_response(client_fd, &response);
-                http_free_response(&response);
-                worker_remove_client(worker, client_fd);
-                return;
+                break;
             }
-
+            
             http_response_t response;
-            http_handle_request(&request, &response);
             
-            client->keep_alive = response.keep_alive;
+            if (parse_result == -2) {
+                // Request too large
+                LOG_WARN("Request too large from %s (fd=%d)", worker_client_address(client), client_fd);
+                http_create_response(&response, 413);
+            } else if (parse_result == -3) {
+                // Unsupported HTTP version
+                LOG_WARN("Unsupported HTTP version from %s (fd=%d)", worker_client_address(client), client_fd);
+                http_create_response(&response, 505);
+            } else if (parse_result != 0) {
+                // Malformed request
+                LOG_WARN("Malformed HTTP request from %s (fd=%d)", worker_client_address(client), client_fd);
+                http_create_response(&response, 400);
+            } else {
+                http_handle_request(&parser->request, &response);
+                client->buffer_consumed += parser->request.length;
+                client->deadline = DEADLINE_NONE;
+            }
             
-            int send_result = http_send_response(client_fd, &response);
-            if (send_result == -1) {
-                worker_remove_client(worker, client_fd);
-                return;
-            } else if (send_result == 0) {
-                struct epoll_event ev;
-                ev.events = EPOLLOUT | EPOLLET | EPOLLRDHUP;
-                ev.data.fd = client_fd;
-                
-                if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, client_fd, &ev) == -1) {
-                    LOG_ERROR("Failed to modify client epoll events for write: %s", strerror(errno));
-                    worker_remove_client(worker, client_fd);
-                    return;
-                }
-                
-                client->pending_response = response;
-                client->has_pending_response = 1;
-                
-                LOG_DEBUG("Response send would block, switching to write monitoring for fd=%d", client_fd);
-                return;
+            if (parse_result != 0) {
+                // nothing after a request we could not frame can be trusted
+                response.keep_alive = 0;
+                client->buffer_consumed = client->buffer_used;
             }
+            http_parser_reset(parser);
             
+            client->keep_alive = response.keep_alive;
+            int push_result = http_output_push(output, &response);
             http_free_response(&response);
-            
-            processed++;
-            offset += req_len;
-
-            if (!client->keep_alive) {
-                LOG_INFO("Closing connection: fd=%d (keep-alive disabled)", client_fd);
+            if (push_result != 0) {
+                http_output_clear(output);
                 worker_remove_client(worker, client_fd);
-                return;
+                return -1;
             }
-
-            struct itimerspec its;
-            its.it_interval.tv_sec = worker->keep_alive_timeout;
-            its.it_interval.tv_nsec = 0;
-            its.it_value.tv_sec = worker->keep_alive_timeout;
-            its.it_value.tv_nsec = 0;
+        }
+        
+        if (client->buffer_consumed == client->buffer_used) {
+            client->buffer_consumed = 0;
+            client->buffer_used = 0;
+        }
+        
+        if (output->count == 0) {
+            worker_set_deadline(worker, client);
+            return 0;
+        }
+        
+        if (worker->ring) {
+            if (worker_uring_start_send(worker, client) != 0) {
+                worker_remove_client(worker, client_fd);
+                return -1;
+            }
+            worker_handle_client_write(worker, client_fd);
+            return -1;
+        }
+        
+        int send_result = http_output_flush(client_fd, output);
+        if (send_result == -1) {
+            http_output_clear(output);
+            worker_remove_client(worker, client_fd);
+            return -1;
+        } else if (send_result == 0) {
+            // the rest is written from EPOLLOUT, so it leaves the batch queue for one of its own
+            client->output = malloc(sizeof(http_output_queue_t));
+            if (!client->output) {
+                LOG_ERROR("Failed to allocate pending output for fd=%d", client_fd);
+                http_output_clear(output);
+                worker_remove_client(worker, client_fd);
+                return -1;
+            }
+            *client->output = *output;
+            output->head = 0;
+            output->count = 0;
             
-            if (timerfd_settime(client->timer_fd, 0, &its, NULL) == -1) {
-                LOG_ERROR("Failed to reset keep-alive timer: %s", strerror(errno));
+            if (worker_wait_writable(worker, client) != 0) {
                 worker_remove_client(worker, client_fd);
-                return;
+                return -1;
             }
+            
+            worker_set_deadline(worker, client);
+            LOG_DEBUG("Response send would block, switching to write monitoring for fd=%d", client_fd);
+            return -1;
         }
+        
+        if (!client->keep_alive) {
+            LOG_INFO("Closing connection: fd=%d (keep-alive disabled)", client_fd);
+            worker_remove_client(worker, client_fd);
+            return -1;
+        }
+    }
+}
+
+// the buffer is full of one request head; nothing more can be parsed from this client
+static void worker_reject_oversized(worker_t *worker, client_conn_t *client) {
+    LOG_WARN("Request too large from %s: %zu bytes", worker_client_address(client), client->buffer_used);
+    http_response_t response;
+    http_create_response(&response, 413);
+    response.keep_alive = 0;
+    http_send_response(client->fd, &response);
+    http_free_response(&response);
+    worker_remove_client(worker, client->fd);
+}
+
+// drops answered requests so the pending one starts the buffer; its parser offsets are relative to it
+static void worker_compact_input(client_conn_t *client) {
+    if (client->buffer_used == BUFFER_SIZE && client->buffer_consumed > 0) {
+        client->buffer_used -= client->buffer_consumed;
+        memmove(client->input->data, client->input->data + client->buffer_consumed, client->buffer_used);
+        client->buffer_consumed = 0;
+    }
+}
 
-        if (offset < total_read) {
-            memmove(client->buffer, client->buffer + offset, total_read - offset);
+// returns -1 once the client has been dropped for trickling its request in byte by byte
+static int worker_account_received(worker_t *worker, client_conn_t *client, size_t bytes) {
+    client->bytes_received += bytes;
+    client->last_activity = worker->now;
+    
+    if (bytes == 1 && client->bytes_received > 100) {
+        if ((client->last_activity - client->connection_start) > 5) {
+            LOG_WARN("Potential slow loris attack from %s: %d single-byte reads", 
+                     worker_client_address(client), client->bytes_received);
+            worker_remove_client(worker, client->fd);
+            return -1;
         }
-    } else if (bytes_read == 0 || (bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK)) {
-        LOG_INFO("Connection closed by client: fd=%d", client_fd);
+    }
+    return 0;
+}
+
+void worker_handle_client_data(worker_t *worker, int client_fd) {
+    client_conn_t *client = worker_find_client(worker, client_fd);
+    if (!client || client->fd != client_fd || client->output) {
+        return;
+    }
+    
+    if (worker_take_input(worker, client) != 0) {
         worker_remove_client(worker, client_fd);
+        return;
+    }
+
+    for (;;) {
+        worker_compact_input(client);
+        if (client->buffer_used == BUFFER_SIZE) {
+            worker_reject_oversized(worker, client);
+            return;
+        }
+        
+        ssize_t bytes_read = recv(client_fd, client->input->data + client->buffer_used,
+                                  BUFFER_SIZE - client->buffer_used, 0);
+        if (bytes_read == 0 || (bytes_read == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            LOG_INFO("Connection closed by client: fd=%d", client_fd);
+            worker_remove_client(worker, client_fd);
+            return;
+        }
+        if (bytes_read == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            worker_release_input(worker, client);
+            return;
+        }
+        
+        client->buffer_used += bytes_read;
+        if (worker_account_received(worker, client, bytes_read) != 0) {
+            return;
+        }
+        
+        if (worker_process_requests(worker, client) != 0) {
+            return;
+        }
     }
 }
 
-void worker_handle_client_write(worker_t *worker, int client_fd) {
-    client_conn_t *client = NULL;
-    for (int i = 0; i < worker->client_count; i++) {
-        if (worker->clients[i].fd == client_fd) {
-            client = &worker->clients[i];
-            break;
+// keeps bytes that arrived while a response is blocked; the epoll path leaves them in the socket instead
+static int worker_spill_input(worker_t *worker, client_conn_t *client, const char *data, size_t length) {
+    client_input_t *input = client->input;
+    
+    if (input->spill_length + length > MAX_REQUEST_SIZE) {
+        LOG_WARN("Too much pipelined data from %s while a response is blocked", worker_client_address(client));
+        worker_remove_client(worker, client->fd);
+        return -1;
+    }
+    
+    char *spill = realloc(input->spill, input->spill_length + length);
+    if (!spill) {
+        LOG_ERROR("Failed to allocate spilled input for fd=%d", client->fd);
+        worker_remove_client(worker, client->fd);
+        return -1;
+    }
+    memcpy(spill + input->spill_length, data, length);
+    input->spill = spill;
+    input->spill_length += length;
+    
+    // a client that keeps pipelining while its responses are written is left in the socket buffer
+    if (input->spill_length >= BUFFER_SIZE && (client->uring_pending & CLIENT_URING_RECV) &&
+        uring_cancel(worker->ring, URING_TAG(URING_RECV, client->generation, client->fd)) != 0) {
+        worker_remove_client(worker, client->fd);
+        return -1;
+    }
+    
+    return 0;
+}
+
+// copies bytes delivered by io_uring into the receive buffer and answers what they complete; returns -1 once the client is gone or blocked
+static int worker_feed_input(worker_t *worker, client_conn_t *client, const char *data, size_t length) {
+    int client_fd = client->fd;
+    
+    if (worker_take_input(worker, client) != 0) {
+        worker_remove_client(worker, client_fd);
+        return -1;
+    }
+    
+    if (client->output) {
+        worker_spill_input(worker, client, data, length);
+        return -1;
+    }
+    
+    while (length > 0) {
+        worker_compact_input(client);
+        if (client->buffer_used == BUFFER_SIZE) {
+            worker_reject_oversized(worker, client);
+            return -1;
+        }
+        
+        size_t chunk = BUFFER_SIZE - client->buffer_used;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(client->input->data + client->buffer_used, data, chunk);
+        client->buffer_used += chunk;
+        data += chunk;
+        length -= chunk;
+        
+        if (worker_process_requests(worker, client) != 0) {
+            // only this client can have been removed, so a surviving lookup is still the same connection
+            client = worker_find_client(worker, client_fd);
+            if (client && length > 0) {
+                worker_spill_input(worker, client, data, length);
+            }
+            return -1;
+        }
+    }
+    
+    return 0;
+}
+
+// a blocked response has drained; returns -1 once the client is gone or blocked again
+static int worker_wait_readable(worker_t *worker, client_conn_t *client) {
+    if (!worker->ring) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
+        ev.data.fd = client->fd;
+        
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, client->fd, &ev) == -1) {
+            LOG_ERROR("Failed to modify client epoll events: %s", strerror(errno));
+            worker_remove_client(worker, client->fd);
+            return -1;
         }
+        return 0;
     }
     
-    if (!client) {
+    // what arrived while the response was blocked comes before anything received from now on
+    if (client->input && client->input->spill) {
+        char *spill = client->input->spill;
+        size_t spill_length = client->input->spill_length;
+        client->input->spill = NULL;
+        client->input->spill_length = 0;
+        
+        int result = worker_feed_input(worker, client, spill, spill_length);
+        free(spill);
+        if (result != 0) {
+            return -1;
+        }
+    }
+    
+    // a receive whose cancellation has not completed yet is re-armed when its last completion arrives
+    if (!(client->uring_pending & CLIENT_URING_RECV) && worker_uring_arm_recv(worker, client) != 0) {
+        worker_remove_client(worker, client->fd);
+        return -1;
+    }
+    return 0;
+}
+
+void worker_handle_client_write(worker_t *worker, int client_fd) {
+    client_conn_t *client = worker_find_client(worker, client_fd);
+    if (!client || client->fd != client_fd) {
         LOG_ERROR("Client not found for fd %d", client_fd);
         return;
     }
     
-    client->last_activity = time(NULL);
+    client->last_activity = worker->now;
     
-    if (client->has_pending_response) {
-        int send_result = http_send_response(client_fd, &client->pending_response);
+    if (client->output) {
+        int send_result = client->send ? worker_uring_flush(worker, client) :
+                                         http_output_flush(client_fd, client->output);
         
         if (send_result == -1) {
             LOG_DEBUG("Failed to send pending response, closing connection fd=%d", client_fd);
             worker_remove_client(worker, client_fd);
             return;
         } else if (send_result == 0) {
-            LOG_DEBUG("Pending response still would block for fd=%d", client_fd);
+            worker_set_deadline(worker, client);
+            LOG_DEBUG("Pending response still being written for fd=%d", client_fd);
             return;
         }
         
         LOG_DEBUG("Successfully sent pending response for fd=%d", client_fd);
-        
-        http_free_response(&client->pending_response);
-        client->has_pending_response = 0;
+        worker_drop_output(worker, client);
         
         if (!client->keep_alive) {
             LOG_INFO("Closing connection after sending pending response: fd=%d", client_fd);
             worker_remove_client(worker, client_fd);
             return;
         }
+        
+        // requests pipelined behind the blocked response are still in the buffer
+        if (worker_process_requests(worker, client) != 0) {
+            return;
+        }
     }
     
-    struct epoll_event ev;
-    ev.events = EPOLLIN | EPOLLET | EPOLLRDHUP;
-    ev.data.fd = client_fd;
-    
-    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, client_fd, &ev) == -1) {
-        LOG_ERROR("Failed to modify client epoll events: %s", strerror(errno));
-        worker_remove_client(worker, client_fd);
+    if (worker_wait_readable(worker, client) != 0) {
         return;
     }
+    worker_release_input(worker, client);
     
     LOG_DEBUG("Client fd %d ready for read operations", client_fd);
 }
 
-void worker_run(worker_t *worker) {
-    LOG_INFO("Worker %d starting event loop on CPU %d (PID %d)", worker->cpu_id, worker->cpu_id, getpid());
+// closes up to ten connections idle for over five seconds when descriptors run out; returns how many
+static int worker_shed_idle(worker_t *worker) {
+    int closed = 0;
+    time_t now = worker->now;
+    
+    // removal moves the last client into slot j, so only advance past survivors
+    for (int j = 0; j < worker->client_count && closed < 10; ) {
+        if (now - worker->clients[j].last_activity > 5) {
+            worker_remove_client(worker, worker->clients[j].fd);
+            closed++;
+        } else {
+            j++;
+        }
+    }
+    
+    if (closed > 0) {
+        LOG_INFO("Emergency closed %d idle connections", closed);
+    }
+    return closed;
+}
+
+// applies the rate limit to a new socket and sets it up; returns 1 if it became a client
+static int worker_accept_client(worker_t *worker, int client_fd, const struct sockaddr_storage *addr) {
+    ratelimit_key_t rate_key;
+    ratelimit_key((const struct sockaddr *)addr, &rate_key);
+    
+    if (!ratelimit_acquire(&rate_key, worker->timers.now_ms)) {
+        close(client_fd);
+        return 0;
+    }
+    
+    optimize_tcp_socket(client_fd);
+    
+    if (worker->count_steering) {
+        int cpu;
+        socklen_t cpu_len = sizeof(cpu);
+        if (getsockopt(client_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &cpu_len) == 0) {
+            if (cpu == worker->cpu_id) {
+                worker->steered_local++;
+            } else {
+                worker->steered_remote++;
+            }
+        }
+    }
     
+    if (worker_handle_connection(worker, client_fd, addr, &rate_key) != 0) {
+        ratelimit_release(&rate_key);
+        return 0;
+    }
+    return 1;
+}
+
+static void worker_expire_timers(worker_t *worker) {
+    timer_wheel_update(&worker->timers);
+    worker->now = worker->timers.now_ms / 1000;
+    
+    int expired_fd;
+    while ((expired_fd = timer_wheel_next_expired(&worker->timers)) != -1) {
+        worker_handle_timeout(worker, expired_fd);
+    }
+}
+
+static void worker_report_stats(worker_t *worker, time_t *last_stats_time, unsigned long *request_count,
+                                unsigned long connection_count) {
+    time_t now = worker->now;
+    if (now - *last_stats_time >= 10) {
+        unsigned long requests_per_sec = *request_count / (now - *last_stats_time);
+        LOG_INFO("Worker %d stats: %lu req/s, %lu total connections, %d current clients",
+                 worker->cpu_id, requests_per_sec, connection_count, worker->client_count);
+        if (worker->count_steering) {
+            LOG_INFO("Worker %d steering: %lu connections received on its CPU, %lu on other CPUs",
+                     worker->cpu_id, worker->steered_local, worker->steered_remote);
+        }
+        *request_count = 0;
+        *last_stats_time = now;
+    }
+}
+
+static void worker_run_epoll(worker_t *worker) {
     int max_accept_per_cycle = 2000;  
     int idle_cycles = 0;
     int max_idle_cycles = 5;  
     
-    struct sockaddr_in client_addr;
-    socklen_t addr_len = sizeof(client_addr);
+    struct sockaddr_storage client_addr;
     
-    time_t last_stats_time = time(NULL);
+    time_t last_stats_time = worker->now;
     unsigned long request_count = 0;
     unsigned long connection_count = 0;
     
@@ -804,7 +1191,7 @@ void worker_run(worker_t *worker) {
             break;
         }
         
-        int timeout = 1000;
+        int timeout = timer_wheel_timeout(&worker->timers, 1000);
         int nfds = epoll_wait(worker->epoll_fd, events, MAX_EVENTS * 2, timeout);
         
         if (nfds == -1) {
@@ -819,6 +1206,8 @@ void worker_run(worker_t *worker) {
             break;
         }
         
+        worker_expire_timers(worker);
+        
         if (nfds == 0) {
             if (shutdown_requested || worker_shutdown_requested) {
                 break;
@@ -863,6 +1252,7 @@ void worker_run(worker_t *worker) {
                 int accepted = 0;
                 
                 while (accepted < max_accept_per_cycle) {
+                    socklen_t addr_len = sizeof(client_addr);
                     int client_fd = accept4(worker->server_fd, 
                                            (struct sockaddr*)&client_addr, 
                                            &addr_len, 
@@ -874,18 +1264,7 @@ void worker_run(worker_t *worker) {
                         } else if (errno == EMFILE || errno == ENFILE) {
                             LOG_WARN("Too many open files (%s), implementing emergency measures", strerror(errno));
                             
-                            int closed = 0;
-                            time_t now = time(NULL);
-                            
-                            for (int j = 0; j < worker->client_count && closed < 10; j++) {
-                                if (now - worker->clients[j].last_activity > 5) {
-                                    worker_remove_client(worker, worker->clients[j].fd);
-                                    closed++;
-                                }
-                            }
-                            
-                            if (closed > 0) {
-                                LOG_INFO("Emergency closed %d idle connections", closed);
+                            if (worker_shed_idle(worker) > 0) {
                                 continue;  
                             }
                             
@@ -897,27 +1276,19 @@ void worker_run(worker_t *worker) {
                         }
                     }
                     
-                    char client_ip[INET_ADDRSTRLEN];
-                    inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-                    
-                    if (!check_rate_limit(client_ip)) {
-                        LOG_WARN("Rate limit exceeded, rejecting connection from %s", client_ip);
-                        close(client_fd);
-                        accepted++;
-                        continue;
+                    if (worker_accept_client(worker, client_fd, &client_addr)) {
+                        connection_count++;
                     }
-                    
-                    optimize_tcp_socket(client_fd);
-                    
-                    worker_handle_connection(worker, client_fd);
                     accepted++;
-                    connection_count++;
                 }
                 
                 if (accepted > 0) {
                     LOG_DEBUG("Accepted %d new connections in batch", accepted);
                 }
             }
+            else if (fd == worker->watch_fd) {
+                watch_handle_events();
+            }
             else if (event_flags & EPOLLIN) {
                 worker_handle_client_data(worker, fd);
                 request_count++;
@@ -930,16 +1301,201 @@ void worker_run(worker_t *worker) {
             }
         }
         
-        time_t now = time(NULL);
-        if (now - last_stats_time >= 10) {
-            unsigned long requests_per_sec = request_count / (now - last_stats_time);
-            LOG_INFO("Worker %d stats: %lu req/s, %lu total connections, %d current clients",
-                     worker->cpu_id, requests_per_sec, connection_count, worker->client_count);
-            request_count = 0;
-            last_stats_time = now;
-            
-            cleanup_rate_limit_table();
+        worker_report_stats(worker, &last_stats_time, &request_count, connection_count);
+    }
+    
+    free(events);
+    LOG_DEBUG("Worker %d exiting after %d iterations", worker->cpu_id, loop_count);
+}
+
+static int worker_uring_arm_accept(worker_t *worker, int slot) {
+    uring_accept_t *accept = &worker->accepts[slot];
+    accept->addr_len = sizeof(accept->addr);
+    return uring_accept(worker->ring, worker->server_fd, (struct sockaddr *)&accept->addr, &accept->addr_len,
+                        URING_TAG(URING_ACCEPT, slot, worker->server_fd));
+}
+
+static void worker_uring_accepted(worker_t *worker, const uring_completion_t *completion,
+                                  unsigned long *connection_count) {
+    int slot = URING_TAG_GENERATION(completion->user_data);
+    
+    if (completion->res >= 0) {
+        if (worker_accept_client(worker, completion->res, &worker->accepts[slot].addr)) {
+            (*connection_count)++;
+        }
+    } else if (completion->res == -EMFILE || completion->res == -ENFILE) {
+        LOG_WARN("Too many open files (%s), implementing emergency measures", strerror(-completion->res));
+        if (worker_shed_idle(worker) == 0) {
+            usleep(20000);
+        }
+    } else if (completion->res != -ECANCELED) {
+        LOG_ERROR("Accept error: %s", strerror(-completion->res));
+    }
+    
+    if (completion->res != -ECANCELED && worker_uring_arm_accept(worker, slot) != 0) {
+        LOG_ERROR("Failed to re-arm accept");
+        worker->is_running = 0;
+    }
+}
+
+static void worker_uring_received(worker_t *worker, client_conn_t *client, const uring_completion_t *completion) {
+    int client_fd = client->fd;
+    
+    if (!completion->more) {
+        client->uring_pending &= ~CLIENT_URING_RECV;
+    }
+    
+    if (completion->res == 0) {
+        LOG_INFO("Connection closed by client: fd=%d", client_fd);
+        worker_remove_client(worker, client_fd);
+        return;
+    }
+    if (completion->res < 0 && completion->res != -ENOBUFS && completion->res != -ECANCELED) {
+        LOG_DEBUG("Receive failed on fd=%d: %s", client_fd, strerror(-completion->res));
+        worker_remove_client(worker, client_fd);
+        return;
+    }
+    
+    if (completion->res > 0) {
+        if (worker_account_received(worker, client, completion->res) != 0) {
+            return;
+        }
+        if (worker_feed_input(worker, client, uring_buffer_data(worker->ring, completion->buffer),
+                              completion->res) != 0) {
+            return;
+        }
+        worker_release_input(worker, client);
+    }
+    
+    // the receive ended because the buffer ring ran dry, a blocked response cancelled it, or the kernel stopped it
+    if (!(client->uring_pending & CLIENT_URING_RECV) && !client->output &&
+        worker_uring_arm_recv(worker, client) != 0) {
+        worker_remove_client(worker, client_fd);
+    }
+}
+
+static void worker_uring_sent(worker_t *worker, client_conn_t *client, const uring_completion_t *completion) {
+    client->uring_pending &= ~CLIENT_URING_SEND;
+    
+    if (completion->res == -EAGAIN) {
+        if (worker_wait_writable(worker, client) != 0) {
+            worker_remove_client(worker, client->fd);
         }
+        return;
+    }
+    if (completion->res < 0) {
+        LOG_DEBUG("Send failed on fd=%d: %s", client->fd, strerror(-completion->res));
+        worker_remove_client(worker, client->fd);
+        return;
+    }
+    
+    http_output_complete(client->output, completion->res);
+    worker_handle_client_write(worker, client->fd);
+}
+
+// the connection is gone, so the batch its last send was reading can be reused now
+static void worker_uring_reap_send(worker_t *worker, uint64_t tag) {
+    for (client_send_t **link = &worker->orphaned_sends; *link; link = &(*link)->next) {
+        client_send_t *send = *link;
+        if (send->tag == tag) {
+            *link = send->next;
+            http_output_clear(&send->queue);
+            send->next = worker->free_sends;
+            worker->free_sends = send;
+            return;
+        }
+    }
+}
+
+static void worker_uring_dispatch(worker_t *worker, const uring_completion_t *completion,
+                                  unsigned long *request_count, unsigned long *connection_count) {
+    int type = URING_TAG_TYPE(completion->user_data);
+    
+    if (type == URING_ACCEPT) {
+        worker_uring_accepted(worker, completion, connection_count);
+        return;
+    }
+    
+    if (type == URING_WATCH) {
+        if (completion->res > 0) {
+            watch_handle_events();
+        }
+        if (!completion->more &&
+            uring_poll(worker->ring, worker->watch_fd, 0, POLLIN, 1, URING_TAG(URING_WATCH, 0, worker->watch_fd)) != 0) {
+            LOG_WARN("Failed to re-arm cache watch");
+        }
+        return;
+    }
+    
+    // completions of a connection that has since been closed, or of an earlier one on the same fd, are dropped
+    client_conn_t *client = worker_find_client(worker, URING_TAG_FD(completion->user_data));
+    if (!client || (client->generation & 0xffffff) != URING_TAG_GENERATION(completion->user_data)) {
+        if (type == URING_SEND) {
+            worker_uring_reap_send(worker, completion->user_data);
+        }
+        return;
+    }
+    
+    if (type == URING_RECV) {
+        worker_uring_received(worker, client, completion);
+        (*request_count)++;
+    } else if (type == URING_POLLOUT) {
+        client->uring_pending &= ~CLIENT_URING_POLL;
+        if (completion->res > 0) {
+            worker_handle_client_write(worker, client->fd);
+        }
+    } else if (type == URING_SEND) {
+        worker_uring_sent(worker, client, completion);
+    }
+}
+
+static void worker_run_uring(worker_t *worker) {
+    uring_t *ring = worker->ring;
+    
+    time_t last_stats_time = worker->now;
+    unsigned long request_count = 0;
+    unsigned long connection_count = 0;
+    
+    for (int slot = 0; slot < URING_ACCEPT_SLOTS; slot++) {
+        if (worker_uring_arm_accept(worker, slot) != 0) {
+            LOG_ERROR("Failed to arm accept");
+            return;
+        }
+    }
+    if (worker->watch_fd != -1 &&
+        uring_poll(ring, worker->watch_fd, 0, POLLIN, 1, URING_TAG(URING_WATCH, 0, worker->watch_fd)) != 0) {
+        LOG_WARN("Failed to arm cache watch");
+    }
+    
+    LOG_INFO("Worker %d entering io_uring loop", worker->cpu_id);
+    
+    while (worker->is_running && !shutdown_requested && !worker_shutdown_requested) {
+        if (uring_wait(ring, timer_wheel_timeout(&worker->timers, 1000)) != 0) {
+            break;
+        }
+        
+        worker_expire_timers(worker);
+        
+        uring_completion_t completion;
+        while (uring_next(ring, &completion)) {
+            worker_uring_dispatch(worker, &completion, &request_count, &connection_count);
+            // handlers copy what they keep, so the buffer goes straight back to the kernel
+            if (completion.buffer != -1) {
+                uring_buffer_return(ring, completion.buffer);
+            }
+        }
+        
+        worker_report_stats(worker, &last_stats_time, &request_count, connection_count);
+    }
+}
+
+void worker_run(worker_t *worker) {
+    LOG_INFO("Worker %d starting event loop on CPU %d (PID %d)", worker->cpu_id, worker->cpu_id, getpid());
+    
+    if (worker->ring) {
+        worker_run_uring(worker);
+    } else {
+        worker_run_epoll(worker);
     }
     
     LOG_INFO("Worker %d shutting down gracefully, closing %d client connections", 
@@ -950,19 +1506,12 @@ void worker_run(worker_t *worker) {
             shutdown(worker->clients[i].fd, SHUT_RDWR);
             close(worker->clients[i].fd);
         }
-        if (worker->clients[i].timer_fd > 0) {
-            close(worker->clients[i].timer_fd);
-        }
-        if (worker->clients[i].buffer) {
-            mempool_free(&worker->buffer_pool, worker->clients[i].buffer);
-        }
-        if (worker->clients[i].has_pending_response) {
-            http_free_response(&worker->clients[i].pending_response);
-        }
+        ratelimit_release(&worker->clients[i].rate_key);
+        worker_free_input(worker, &worker->clients[i]);
+        worker_drop_output(worker, &worker->clients[i]);
     }
-    
-    free(events);
-    LOG_DEBUG("Worker %d exiting after %d iterations", worker->cpu_id, loop_count);
+    // everything is released; worker_cleanup() must not see these clients again
+    worker->client_count = 0;
 }
 
 void worker_cleanup(worker_t *worker) {
@@ -971,15 +1520,38 @@ void worker_cleanup(worker_t *worker) {
     }
     
     for (int i = 0; i < worker->client_count; i++) {
-        if (worker->clients[i].buffer) {
-            mempool_free(&worker->buffer_pool, worker->clients[i].buffer);
-        }
+        ratelimit_release(&worker->clients[i].rate_key);
+        worker_free_input(worker, &worker->clients[i]);
         close(worker->clients[i].fd);
-        close(worker->clients[i].timer_fd);
+    }
+    
+    if (worker->ring) {
+        uring_cleanup(worker->ring);
+        free(worker->ring);
+    }
+    free(worker->accepts);
+    
+    // with the ring gone nothing reads the orphaned batches any more
+    while (worker->orphaned_sends) {
+        client_send_t *send = worker->orphaned_sends;
+        worker->orphaned_sends = send->next;
+        http_output_clear(&send->queue);
+        free(send);
+    }
+    while (worker->free_sends) {
+        client_send_t *send = worker->free_sends;
+        worker->free_sends = send->next;
+        free(send);
     }
     
     free(worker->clients);
+    free(worker->fd_table);
+    timer_wheel_cleanup(&worker->timers);
     free(worker->events);
     close(worker->epoll_fd);
+    if (worker->watch_fd != -1) {
+        watch_cleanup();
+    }
+    filecache_cleanup();
     mempool_cleanup(&worker->buffer_pool);
 } 
\ No newline at end of file